@@ -0,0 +1,110 @@
+"""
+Python module to fit the main to tail rotor coupling of the helicopter rig.
+
+Reads sessions logged by test/couplingTest.c and prints the tail coupling
+table and rate gain for src/axis_controller.c.
+"""
+
+import numpy
+import os
+import re
+
+# Path location of the data files
+DATA_PATH = os.path.join('data', 'coupling')
+
+# Rate in Hz of the serial output
+SAMPLING_RATE = 50
+
+# Main rotor duty cycles (permille) of the coupling table entries
+TABLE_POINTS = numpy.linspace(0, 1000, 11)
+
+# Largest yaw rate (notches per second) of a sample counted as holding yaw
+YAW_RATE_HELD = 20
+
+
+def get_files(path):
+    """
+
+    :param path: the directory containing the data files
+    :return: all of the txt files within the data directory
+    """
+    with os.scandir(path) as it:
+        return [entry.path for entry in it if entry.name.endswith('.txt') and entry.is_file()]
+
+
+def process_sessions(filename):
+    """
+    File has the following format.
+
+    start
+    main_1, tail_1, yaw_rate_1
+    ...
+    main_n, tail_n, yaw_rate_n
+    end
+
+    :param filename: the file to process
+    :return: a list of (main, tail, yaw_rate) arrays, one per session
+    """
+    with open(filename) as infile:
+        text = infile.read()
+
+    pattern = re.compile('^start(.+?)^end$', re.MULTILINE | re.DOTALL)
+    sessions = []
+    for session in pattern.findall(text):
+        # If session was started after a hard reset only look at the data after the last start
+        (_, _, session) = session.rpartition('start')
+
+        rows = [list(map(int, line.split(','))) for line in session.split('\n') if line.count(',') == 2]
+        if rows:
+            sessions.append(numpy.array(rows).T)
+    return sessions
+
+
+def hat_basis(main):
+    """
+
+    :param main: main rotor duty cycles
+    :return: the weight of each table entry when linearly interpolating at each duty cycle
+    """
+    spacing = TABLE_POINTS[1] - TABLE_POINTS[0]
+    return numpy.clip(1 - abs(main[:, None] - TABLE_POINTS[None, :]) / spacing, 0, None)
+
+
+def fit_coupling(sessions):
+    """
+    Fit the tail duty cycle holding the yaw as the interpolated table of the main
+    duty cycle plus a gain times the main duty cycle rate, by least squares over
+    the samples where the yaw is held.
+
+    :param sessions: the logged sessions
+    :return: a tuple of the form (table, rate_gain), the rate gain in seconds
+    """
+    rows = []
+    targets = []
+    for (main, tail, yaw_rate) in sessions:
+        main_rate = numpy.gradient(main.astype(float)) * SAMPLING_RATE
+        held = abs(yaw_rate) <= YAW_RATE_HELD
+        rows.append(numpy.hstack((hat_basis(main[held].astype(float)), main_rate[held, None])))
+        targets.append(tail[held].astype(float))
+
+    (solution, _, _, _) = numpy.linalg.lstsq(numpy.vstack(rows), numpy.hstack(targets), rcond=None)
+    return (solution[:-1], solution[-1])
+
+
+def main():
+    sessions = []
+    for infile in get_files(DATA_PATH):
+        sessions += process_sessions(infile)
+    print('{} sessions in total\n'.format(len(sessions)))
+    if not sessions:
+        return
+
+    (table, rate_gain) = fit_coupling(sessions)
+    print('static const int32_t tail_coupling_table[] = {')
+    entries = ['    /* {:3.0f}% */ {}'.format(point / 10, int(round(value))) for (point, value) in zip(TABLE_POINTS, table)]
+    print(',\n'.join(entries))
+    print('};\n')
+    print('#define TAIL_COUPLING_RATE      {}'.format(int(round(rate_gain * 1000))))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,147 @@
+/**
+ * @file autotune.c
+ *
+ * @brief Relay feedback auto-tuner for the axis controllers.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "autotune.h"
+#include "axis_controller.h"
+#include "pid.h"
+
+#define PI                      3.14159265f
+
+static volatile uint8_t autotune_state = AUTOTUNE_IDLE;
+static uint8_t autotune_axis;
+
+/*
+ * Relay configuration.
+ */
+static int32_t relay_bias;
+static int32_t relay_amplitude;
+static int32_t relay_hysteresis;
+static bool relay_high;
+
+/*
+ * Limit cycle measurement. Cycles are timed between rising relay switches.
+ */
+static uint32_t elapsed;
+static uint32_t rise_time;
+static uint8_t cycles;
+static int32_t error_min;
+static int32_t error_max;
+static uint32_t period_total;
+static int32_t amplitude_total;
+
+/*
+ * Result of the last successful auto-tune.
+ */
+static float result_gain;
+static uint32_t result_period;
+
+/**
+ * Compute the ultimate gain and period from the measured cycles and write
+ * the tuned gains into the axis.
+ */
+static void AutotuneFinish(void) {
+    /*
+     * Describing function of a relay with hysteresis.
+     */
+    float amplitude = (float) amplitude_total / (2.0f * AUTOTUNE_CYCLES);
+    float hysteresis = (float) relay_hysteresis;
+    if (amplitude <= hysteresis) {
+        autotune_state = AUTOTUNE_FAILED;
+        SetAxisLaw(autotune_axis, NULL);
+        return;
+    }
+    result_gain = 4.0f * (float) relay_amplitude
+            / (PI * sqrtf(amplitude * amplitude - hysteresis * hysteresis));
+    result_period = period_total / AUTOTUNE_CYCLES;
+
+    PidGains gains;
+    PidGainsTune(&gains, result_gain, (float) result_period);
+    SetAxisGains(autotune_axis, &gains);
+    SetAxisLaw(autotune_axis, NULL);
+    autotune_state = AUTOTUNE_DONE;
+}
+
+/**
+ * The relay control law. Runs in the control interrupt.
+ */
+static int32_t RelayLaw(int32_t error, uint32_t delta_t) {
+    elapsed += delta_t;
+    error_min = (error < error_min) ? error : error_min;
+    error_max = (error > error_max) ? error : error_max;
+
+    if (!relay_high && error > relay_hysteresis) {
+        relay_high = true;
+
+        /*
+         * A full cycle has passed since the last rising switch.
+         */
+        if (rise_time != 0) {
+            if (cycles >= AUTOTUNE_SETTLE_CYCLES) {
+                period_total += elapsed - rise_time;
+                amplitude_total += error_max - error_min;
+            }
+            cycles++;
+        }
+        rise_time = elapsed;
+        error_min = error;
+        error_max = error;
+    } else if (relay_high && error < -relay_hysteresis) {
+        relay_high = false;
+    }
+
+    int32_t control = relay_high ? relay_bias + relay_amplitude :
+                      relay_bias - relay_amplitude;
+
+    if (cycles >= AUTOTUNE_SETTLE_CYCLES + AUTOTUNE_CYCLES) {
+        AutotuneFinish();
+    } else if (elapsed > AUTOTUNE_TIMEOUT) {
+        autotune_state = AUTOTUNE_FAILED;
+        SetAxisLaw(autotune_axis, NULL);
+    }
+    return control;
+}
+
+void AutotuneStart(uint8_t axis, int32_t amplitude, int32_t hysteresis) {
+    AutotuneStop();
+
+    autotune_axis = axis;
+    relay_bias = GetAxisOutput(axis);
+    relay_amplitude = amplitude;
+    relay_hysteresis = hysteresis;
+    relay_high = false;
+
+    elapsed = 0;
+    rise_time = 0;
+    cycles = 0;
+    error_min = INT32_MAX;
+    error_max = INT32_MIN;
+    period_total = 0;
+    amplitude_total = 0;
+
+    autotune_state = AUTOTUNE_RUNNING;
+    SetAxisLaw(axis, RelayLaw);
+}
+
+void AutotuneStop(void) {
+    if (autotune_state == AUTOTUNE_RUNNING) {
+        autotune_state = AUTOTUNE_FAILED;
+        SetAxisLaw(autotune_axis, NULL);
+    }
+}
+
+uint8_t GetAutotuneState(void) {
+    return autotune_state;
+}
+
+void GetAutotuneResult(float *ultimate_gain, uint32_t *ultimate_period) {
+    *ultimate_gain = result_gain;
+    *ultimate_period = result_period;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file autotune.h
+ *
+ * @brief Relay feedback auto-tuner for the axis controllers.
+ */
+
+/**
+ * @defgroup autotune_api Autotune
+ * @ingroup pid_api
+ *
+ * Relay feedback (Astrom-Hagglund) auto-tuner. The pid controller of an axis
+ * is replaced by a relay which drives the axis into a limit cycle. The
+ * ultimate gain and period are measured from the zero crossings of the error
+ * as the cycle runs, and the resulting gains are written into the axis.
+ * @{
+ */
+
+#ifndef AUTOTUNE_H_
+#define AUTOTUNE_H_
+
+/*
+ * Number of limit cycles to let settle before measuring.
+ */
+#define AUTOTUNE_SETTLE_CYCLES  2
+
+/*
+ * Number of limit cycles averaged for the result.
+ */
+#define AUTOTUNE_CYCLES         4
+
+/*
+ * Longest an auto-tune may run before giving up (us).
+ */
+#define AUTOTUNE_TIMEOUT        60000000
+
+/**
+ * The states of the auto-tuner.
+ */
+enum AutotuneState {
+    /**
+     * No auto-tune has been run.
+     */
+    AUTOTUNE_IDLE,
+    /**
+     * The relay is driving the axis.
+     */
+    AUTOTUNE_RUNNING,
+    /**
+     * The gains have been measured and written into the axis.
+     */
+    AUTOTUNE_DONE,
+    /**
+     * The auto-tune timed out or was stopped, the gains are unchanged.
+     */
+    AUTOTUNE_FAILED
+};
+
+/**
+ * Start auto-tuning an axis. The relay switches around the current output of
+ * the axis, so the axis should be holding its target.
+ *
+ * @param axis The axis.
+ * @param amplitude The relay amplitude, in control units.
+ * @param hysteresis The error the relay ignores, in sensor units. Should be
+ * just above the sensor noise.
+ */
+void AutotuneStart(uint8_t axis, int32_t amplitude, int32_t hysteresis);
+
+/**
+ * Stop the auto-tune and return the axis to its pid controller with the
+ * gains unchanged.
+ */
+void AutotuneStop(void);
+
+/**
+ * Get the state of the auto-tuner.
+ *
+ * @return One of enum AutotuneState.
+ */
+uint8_t GetAutotuneState(void);
+
+/**
+ * Get the result of the last successful auto-tune.
+ *
+ * @param ultimate_gain The ultimate gain, in control per sensor unit.
+ * @param ultimate_period The ultimate period (us).
+ */
+void GetAutotuneResult(float *ultimate_gain, uint32_t *ultimate_period);
+
+#endif /* AUTOTUNE_H_ */
+
+/** @} */
@@ -0,0 +1,448 @@
+/**
+ * @file axis_controller.c
+ *
+ * @brief Pid controllers for every controlled axis of the helicopter.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "driverlib/debug.h"
+
+#include "axis_controller.h"
+#include "clock.h"
+#include "flight_controller.h"
+#include "height.h"
+#include "pid.h"
+#include "pwm.h"
+#include "yaw.h"
+
+static int32_t GetMainRotorDuty(void);
+static void SetMainRotor(int32_t control);
+static void SetTailRotor(int32_t control);
+static void SetYawRateTarget(int32_t control);
+static int32_t GetTailRotorFeedforward(void);
+
+/*
+ * Range of the gain schedule variables. Gain table entries are spaced evenly
+ * over this range.
+ */
+#define SCHEDULE_RANGE          100
+
+/*
+ * Longest measured update period an axis is run with, in nominal periods. Stops
+ * a stall in the control interrupt from winding the integrators up.
+ */
+#define AXIS_DELTA_T_MAX_PERIODS 4
+
+/*
+ * Axis actuator which does not drive a rotor through the shaping stage.
+ */
+#define NO_ROTOR                -1
+
+/*
+ * Largest yaw rate the heading loop may command (notches per second).
+ */
+#define YAW_RATE_MAX            (YAW_FULL_ROTATION / 2)
+
+/*
+ * Tail rotor duty cycle (permille) holding the yaw against the main rotor
+ * reaction torque, at main rotor duty cycles spaced evenly over
+ * SCHEDULE_RANGE. Zero gives the tail rotor loop no feedforward.
+ */
+static const int32_t tail_coupling_table[] = {
+    /*   0% */ 0,
+    /*  10% */ 0,
+    /*  20% */ 0,
+    /*  30% */ 0,
+    /*  40% */ 0,
+    /*  50% */ 0,
+    /*  60% */ 0,
+    /*  70% */ 0,
+    /*  80% */ 0,
+    /*  90% */ 0,
+    /* 100% */ 0
+};
+
+/*
+ * Tail rotor duty cycle per main rotor duty cycle rate (per second), in
+ * milliseconds, on the applied main rotor duty cycle. Covers the rotor spin
+ * up torque.
+ */
+#define TAIL_COUPLING_RATE      0
+
+/*
+ * Gain scheduling is opt-in. An axis is only scheduled when it has a schedule
+ * variable and its gain table has more than one entry, in which case the
+ * entries are spaced evenly over SCHEDULE_RANGE and interpolated on every
+ * update. An axis with a single entry runs on fixed gains.
+ */
+
+/*
+ * Main rotor gains, scheduled on the height (%).
+ */
+static const PidGains height_gain_table[] = {
+    PID_TUNED_GAINS(1.10, 850000.0)
+};
+
+/*
+ * Heading gains. The heading loop commands a yaw rate, so it is mostly
+ * proportional and is not scheduled.
+ */
+static const PidGains yaw_gain_table[] = {
+    PID_GAINS(4.0, 0.0, 0.0)
+};
+
+/*
+ * Tail rotor gains, scheduled on the main rotor duty cycle (%).
+ */
+static const PidGains yaw_rate_gain_table[] = {
+    PID_GAINS(1.0, 1.0 / 200000.0, 0.0)
+};
+
+/*
+ * The axis table. A new axis only needs an entry in enum Axis and here.
+ */
+static const struct {
+    /**
+     * Get the current sensor reading.
+     */
+    int32_t (*sensor[NUM_AXES])(void);
+
+    /**
+     * Apply the control output.
+     */
+    void (*actuator[NUM_AXES])(int32_t control);
+
+    /**
+     * The rotor the actuator drives through the shaping stage, or NO_ROTOR if
+     * the control is applied at once. The pid output of a rotor axis is
+     * clamped to what the slew limit can reach by the next update, so the
+     * integrator holds while the rotor catches up. The integrator itself is
+     * still bounded by the full output range.
+     */
+    int8_t rotor[NUM_AXES];
+
+    /**
+     * Update rate (Hz). Must divide CONTROL_FREQUENCY.
+     */
+    uint32_t frequency[NUM_AXES];
+
+    /**
+     * Valid control output range.
+     */
+    PidLimits limits[NUM_AXES];
+
+    /**
+     * Valid target range (axis units).
+     */
+    int32_t target_min[NUM_AXES];
+    int32_t target_max[NUM_AXES];
+
+    /**
+     * Sensor units per unit_range axis units.
+     */
+    int32_t sensor_range[NUM_AXES];
+    int32_t unit_range[NUM_AXES];
+
+    /**
+     * Get the gain schedule variable, in the range 0 to SCHEDULE_RANGE, or
+     * NULL to always use the first gain table entry. Ignored for a gain table
+     * with a single entry.
+     */
+    int32_t (*schedule[NUM_AXES])(void);
+
+    /**
+     * Get the control added to the pid output, or NULL for none.
+     */
+    int32_t (*feedforward[NUM_AXES])(void);
+
+    /**
+     * Gain table, interpolated on the schedule variable.
+     */
+    const PidGains *gain_table[NUM_AXES];
+    uint32_t gain_table_size[NUM_AXES];
+} axis_table = {
+    .sensor = {
+        [AXIS_HEIGHT] = GetHeight,
+        [AXIS_YAW] = GetYaw,
+        [AXIS_YAW_RATE] = GetYawRate },
+    .actuator = {
+        [AXIS_HEIGHT] = SetMainRotor,
+        [AXIS_YAW] = SetYawRateTarget,
+        [AXIS_YAW_RATE] = SetTailRotor },
+    .rotor = {
+        [AXIS_HEIGHT] = MAIN_ROTOR,
+        [AXIS_YAW] = NO_ROTOR,
+        [AXIS_YAW_RATE] = TAIL_ROTOR },
+    .frequency = {
+        [AXIS_HEIGHT] = HEIGHT_CONTROL_FREQUENCY,
+        [AXIS_YAW] = YAW_CONTROL_FREQUENCY,
+        [AXIS_YAW_RATE] = YAW_RATE_CONTROL_FREQUENCY },
+    .limits = {
+        [AXIS_HEIGHT] = { .output_min = 50, .output_max = 950 },
+        [AXIS_YAW] = { .output_min = -YAW_RATE_MAX, .output_max = YAW_RATE_MAX },
+        [AXIS_YAW_RATE] = { .output_min = 20, .output_max = 950 } },
+    .target_min = {
+        [AXIS_HEIGHT] = 0,
+        [AXIS_YAW] = INT32_MIN,
+        [AXIS_YAW_RATE] = -YAW_RATE_MAX * 360 / YAW_FULL_ROTATION },
+    .target_max = {
+        [AXIS_HEIGHT] = 100,
+        [AXIS_YAW] = INT32_MAX,
+        [AXIS_YAW_RATE] = YAW_RATE_MAX * 360 / YAW_FULL_ROTATION },
+    .sensor_range = {
+        [AXIS_HEIGHT] = FULL_SCALE_RANGE,
+        [AXIS_YAW] = YAW_FULL_ROTATION,
+        [AXIS_YAW_RATE] = YAW_FULL_ROTATION },
+    .unit_range = {
+        [AXIS_HEIGHT] = 100,
+        [AXIS_YAW] = 360,
+        [AXIS_YAW_RATE] = 360 },
+    .schedule = {
+        [AXIS_HEIGHT] = GetHeightPercentage,
+        [AXIS_YAW] = NULL,
+        [AXIS_YAW_RATE] = GetMainRotorDuty },
+    .feedforward = {
+        [AXIS_HEIGHT] = NULL,
+        [AXIS_YAW] = NULL,
+        [AXIS_YAW_RATE] = GetTailRotorFeedforward },
+    .gain_table = {
+        [AXIS_HEIGHT] = height_gain_table,
+        [AXIS_YAW] = yaw_gain_table,
+        [AXIS_YAW_RATE] = yaw_rate_gain_table },
+    .gain_table_size = {
+        [AXIS_HEIGHT] = sizeof(height_gain_table) / sizeof(PidGains),
+        [AXIS_YAW] = sizeof(yaw_gain_table) / sizeof(PidGains),
+        [AXIS_YAW_RATE] = sizeof(yaw_rate_gain_table) / sizeof(PidGains) }
+};
+
+/*
+ * Run time state of every axis.
+ */
+static struct {
+    PidGains gains[NUM_AXES];
+    PidState state[NUM_AXES];
+    bool scheduled[NUM_AXES];
+    AxisLaw law[NUM_AXES];
+    int32_t output[NUM_AXES];
+    uint32_t main_ticks;
+    int32_t main_ticks_delta;
+    int32_t target[NUM_AXES];
+    int32_t target_units[NUM_AXES];
+    uint32_t period[NUM_AXES];
+    uint64_t last_update[NUM_AXES];
+    uint32_t divider[NUM_AXES];
+    uint32_t ticks[NUM_AXES];
+} axes;
+
+/**
+ * Get the main rotor duty cycle applied by the shaping stage, over
+ * SCHEDULE_RANGE.
+ */
+static int32_t GetMainRotorDuty(void) {
+    return (int32_t) GetPwmDutyPermille(MAIN_ROTOR) * SCHEDULE_RANGE
+            / PWM_DUTY_SCALE;
+}
+
+static void SetMainRotor(int32_t control) {
+    SetPwmThrust(MAIN_ROTOR, control);
+}
+
+static void SetTailRotor(int32_t control) {
+    SetPwmThrust(TAIL_ROTOR, control);
+}
+
+static void SetYawRateTarget(int32_t control) {
+    SetAxisTargetRaw(AXIS_YAW_RATE, control);
+}
+
+void AxisControllerInit(void) {
+    for (uint8_t i = 0; i < NUM_AXES; i++) {
+        axes.gains[i] = axis_table.gain_table[i][0];
+        axes.scheduled[i] = (axis_table.schedule[i] != NULL)
+                && (axis_table.gain_table_size[i] > 1);
+        axes.law[i] = NULL;
+        axes.output[i] = 0;
+        PidInit(&axes.state[i]);
+
+        axes.divider[i] = CONTROL_FREQUENCY / axis_table.frequency[i];
+        axes.period[i] = 1000000 / axis_table.frequency[i];
+        axes.last_update[i] = 0;
+        axes.ticks[i] = 0;
+    }
+    axes.main_ticks = GetPwmDutyTicks(MAIN_ROTOR);
+    axes.main_ticks_delta = 0;
+}
+
+/**
+ * Tail rotor control cancelling the main rotor reaction torque, from the
+ * main rotor duty cycle applied by the shaping stage and its rate of change.
+ */
+static int32_t GetTailRotorFeedforward(void) {
+    uint32_t weight;
+    uint32_t index = PidTablePosition(GetMainRotorDuty(), SCHEDULE_RANGE,
+            sizeof(tail_coupling_table) / sizeof(int32_t), &weight);
+    int32_t lower = tail_coupling_table[index];
+    int32_t upper = tail_coupling_table[index + 1];
+    int32_t steady = lower + (((upper - lower) * (int32_t) weight)
+            >> PID_WEIGHT_SHIFT);
+
+    /*
+     * The change over one control tick is less than a period, so the
+     * product fits in 32 bits before the division.
+     */
+    int32_t transient = axes.main_ticks_delta
+            * (PWM_DUTY_SCALE * TAIL_COUPLING_RATE) / (int32_t) GetPwmPeriod()
+            * CONTROL_FREQUENCY / 1000;
+    return steady + transient;
+}
+
+/**
+ * Narrow the output range of a rotor axis to the thrust the shaping stage can
+ * reach by the next update of the axis. Only used to clamp the pid output, not
+ * to bound its integrator.
+ */
+static inline void AxisSlewLimits(uint8_t axis, PidLimits *limits) {
+    uint8_t rotor = (uint8_t) axis_table.rotor[axis];
+    int32_t thrust = (int32_t) GetPwmThrust(rotor);
+    int32_t reach = (int32_t) GetPwmThrustSlew(rotor, axes.divider[axis]);
+    int32_t low = thrust - reach;
+    int32_t high = thrust + reach;
+    limits->output_min = (low < limits->output_min) ? limits->output_min :
+                         (low > limits->output_max) ? limits->output_max : low;
+    limits->output_max = (high > limits->output_max) ? limits->output_max :
+                         (high < limits->output_min) ? limits->output_min : high;
+}
+
+/**
+ * Interpolate the gains of an axis from its gain table, moving the change in
+ * output into the integrator so the new gains do not bump the output.
+ */
+static inline void ScheduleGains(uint8_t axis) {
+    PidGains gains;
+    PidGainsSchedule(&gains, axis_table.gain_table[axis],
+            axis_table.gain_table_size[axis], axis_table.schedule[axis](),
+            SCHEDULE_RANGE);
+    PidBumplessTransfer(&axes.state[axis], &axes.gains[axis], &gains);
+    axes.gains[axis] = gains;
+}
+
+/**
+ * Measure the time since an axis was last updated, falling back to its
+ * nominal period on the first update.
+ */
+static inline uint32_t AxisDeltaT(uint8_t axis, uint64_t now) {
+    uint64_t last = axes.last_update[axis];
+    axes.last_update[axis] = now;
+    if (last == 0) {
+        return axes.period[axis];
+    }
+
+    uint64_t elapsed = now - last;
+    uint32_t delta_t = TicksToMicros((elapsed > UINT32_MAX) ? UINT32_MAX :
+            (uint32_t) elapsed);
+    uint32_t delta_t_max = axes.period[axis] * AXIS_DELTA_T_MAX_PERIODS;
+    return (delta_t == 0) ? 1 :
+           (delta_t > delta_t_max) ? delta_t_max : delta_t;
+}
+
+void UpdateAxisControllers(void) {
+    uint64_t now = MonotonicTicks();
+
+    /*
+     * Change in the applied main rotor pulse width over the last control
+     * tick, for the tail rotor feedforward.
+     */
+    uint32_t main_ticks = GetPwmDutyTicks(MAIN_ROTOR);
+    axes.main_ticks_delta = (int32_t) (main_ticks - axes.main_ticks);
+    axes.main_ticks = main_ticks;
+
+    for (uint8_t i = 0; i < NUM_AXES; i++) {
+        axes.ticks[i]++;
+        if (axes.ticks[i] < axes.divider[i]) {
+            continue;
+        }
+        axes.ticks[i] = 0;
+        uint32_t delta_t = AxisDeltaT(i, now);
+
+        if (axes.scheduled[i]) {
+            ScheduleGains(i);
+        }
+
+        int32_t control;
+        if (axes.law[i] != NULL) {
+            const PidLimits *limits = &axis_table.limits[i];
+            control = axes.law[i](axes.target[i] - axis_table.sensor[i](),
+                    delta_t);
+            control = (control < limits->output_min) ? limits->output_min :
+                      (control > limits->output_max) ? limits->output_max :
+                      control;
+        } else {
+            int32_t feedforward = (axis_table.feedforward[i] != NULL) ?
+                    axis_table.feedforward[i]() : 0;
+            PidLimits reach = axis_table.limits[i];
+            if (axis_table.rotor[i] != NO_ROTOR) {
+                AxisSlewLimits(i, &reach);
+            }
+            control = UpdatePid(&axes.state[i], axes.target[i],
+                    axis_table.sensor[i](), feedforward, delta_t,
+                    &axes.gains[i], &axis_table.limits[i], &reach);
+        }
+        axes.output[i] = control;
+        axis_table.actuator[i](control);
+    }
+}
+
+void SetAxisTarget(uint8_t axis, int32_t target) {
+    ASSERT(target >= axis_table.target_min[axis]);
+    ASSERT(target <= axis_table.target_max[axis]);
+
+    axes.target_units[axis] = target;
+    axes.target[axis] = target * axis_table.sensor_range[axis]
+            / axis_table.unit_range[axis];
+}
+
+int32_t GetAxisTarget(uint8_t axis) {
+    return axes.target_units[axis];
+}
+
+void SetAxisTargetRaw(uint8_t axis, int32_t target) {
+    axes.target[axis] = target;
+    axes.target_units[axis] = target * axis_table.unit_range[axis]
+            / axis_table.sensor_range[axis];
+}
+
+int32_t GetAxisTargetRaw(uint8_t axis) {
+    return axes.target[axis];
+}
+
+void PreloadAxisController(uint8_t axis, int32_t control, int32_t error) {
+    int32_t sensor_error = error * axis_table.sensor_range[axis]
+            / axis_table.unit_range[axis];
+    PreloadPid(&axes.state[axis], &axes.gains[axis], control, sensor_error);
+}
+
+int32_t GetAxisOutput(uint8_t axis) {
+    return axes.output[axis];
+}
+
+int32_t GetAxisIntegral(uint8_t axis) {
+    return PidIntegralGet(&axes.state[axis]);
+}
+
+void SetAxisLaw(uint8_t axis, AxisLaw law) {
+    if (law == NULL && axes.law[axis] != NULL) {
+        PidInit(&axes.state[axis]);
+        PreloadPid(&axes.state[axis], &axes.gains[axis], axes.output[axis],
+                axes.target[axis] - axis_table.sensor[axis]());
+    }
+    axes.law[axis] = law;
+}
+
+void SetAxisGains(uint8_t axis, const PidGains *gains) {
+    axes.scheduled[axis] = false;
+    PidBumplessTransfer(&axes.state[axis], &axes.gains[axis], gains);
+    axes.gains[axis] = *gains;
+}
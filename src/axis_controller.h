@@ -0,0 +1,151 @@
+/**
+ * @file axis_controller.h
+ *
+ * @brief Pid controllers for every controlled axis of the helicopter.
+ */
+
+/**
+ * @defgroup axis_controller AxisController
+ * @ingroup pid_api
+ *
+ * Pid controllers for every controlled axis of the helicopter. Each axis is
+ * described by an entry in the axis table, which holds its sensor, actuator,
+ * tuning, limits and units, and all axes are updated in a single pass.
+ * @{
+ */
+
+#ifndef AXIS_CONTROLLER_H_
+#define AXIS_CONTROLLER_H_
+
+#include "pid.h"
+
+/**
+ * The controlled axes.
+ */
+enum Axis {
+    /**
+     * The height axis, driven by the main rotor. Targets are in %.
+     */
+    AXIS_HEIGHT,
+    /**
+     * The yaw heading axis, driving the yaw rate target. Targets are in
+     * degrees.
+     */
+    AXIS_YAW,
+    /**
+     * The yaw rate axis, driven by the tail rotor. Targets are in degrees per
+     * second. Updated after AXIS_YAW so it follows the new rate target in the
+     * same pass.
+     */
+    AXIS_YAW_RATE,
+    /**
+     * The total number of axes.
+     */
+    NUM_AXES
+};
+
+/**
+ * A control law which replaces the pid controller of an axis.
+ *
+ * @param error The difference between the target and the sensor reading, in
+ * sensor units.
+ * @param delta_t The measured time since the last update of the axis (us).
+ * @return The control output.
+ */
+typedef int32_t (*AxisLaw)(int32_t error, uint32_t delta_t);
+
+/**
+ * Initialise the controllers of all axes. Resets the gains to their default
+ * tuning and clears the pid state.
+ */
+void AxisControllerInit(void);
+
+/**
+ * Update the controllers of all axes which are due. Must be called at
+ * CONTROL_FREQUENCY.
+ */
+void UpdateAxisControllers(void);
+
+/**
+ * Set the target of an axis.
+ *
+ * @param axis The axis.
+ * @param target The target, in the units of the axis.
+ */
+void SetAxisTarget(uint8_t axis, int32_t target);
+
+/**
+ * Get the target of an axis.
+ *
+ * @param axis The axis.
+ * @return The target, in the units of the axis.
+ */
+int32_t GetAxisTarget(uint8_t axis);
+
+/**
+ * Set the target of an axis in sensor units.
+ *
+ * @param axis The axis.
+ * @param target The target, in sensor units.
+ */
+void SetAxisTargetRaw(uint8_t axis, int32_t target);
+
+/**
+ * Get the target of an axis in sensor units.
+ *
+ * @param axis The axis.
+ * @return The target, in sensor units.
+ */
+int32_t GetAxisTargetRaw(uint8_t axis);
+
+/**
+ * Preload the integral component of the pid controller of an axis so its
+ * actuator starts off with @p control power.
+ *
+ * This improves the rise time of the helicopter by boosting the rotor.
+ *
+ * @param axis The axis.
+ * @param control The immediate control power desired.
+ * @param error The absolute difference between the current and target value,
+ * in the units of the axis.
+ */
+void PreloadAxisController(uint8_t axis, int32_t control, int32_t error);
+
+/**
+ * Get the last control output of an axis.
+ *
+ * @param axis The axis.
+ * @return The control output.
+ */
+int32_t GetAxisOutput(uint8_t axis);
+
+/**
+ * Get the integral term of the pid controller of an axis.
+ *
+ * @param axis The axis.
+ * @return The integral term, in control units.
+ */
+int32_t GetAxisIntegral(uint8_t axis);
+
+/**
+ * Replace the pid controller of an axis with another control law, or return
+ * to the pid controller. The pid controller resumes from the last output of
+ * the law.
+ *
+ * @param axis The axis.
+ * @param law The control law, or NULL for the pid controller.
+ */
+void SetAxisLaw(uint8_t axis, AxisLaw law);
+
+/**
+ * Set the gains of an axis, replacing its gain schedule. The output does not
+ * bump when the gains change.
+ *
+ * @param axis The axis.
+ * @param gains The new gains.
+ */
+void SetAxisGains(uint8_t axis, const PidGains *gains);
+
+#endif /* AXIS_CONTROLLER_H_ */
+
+/** @} */
@@ -0,0 +1,69 @@
+/**
+ * @file clock.c
+ *
+ * @brief Monotonic microsecond clock shared by the sensors and controllers.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "inc/hw_memmap.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/timer.h"
+
+#include "clock.h"
+
+/*
+ * Wide timer definitions. The two halves are concatenated into a single 64-bit
+ * timer counting up at the system clock.
+ */
+#define CLOCK_TIMER_PERIPH      SYSCTL_PERIPH_WTIMER0
+#define CLOCK_TIMER_BASE        WTIMER0_BASE
+#define CLOCK_TIMER             TIMER_A
+
+static uint32_t ticks_per_second;
+static uint32_t ticks_per_us;
+
+void ClockInit(void) {
+    ticks_per_second = SysCtlClockGet();
+    ticks_per_us = ticks_per_second / 1000000;
+
+    SysCtlPeripheralEnable(CLOCK_TIMER_PERIPH);
+    TimerConfigure(CLOCK_TIMER_BASE, TIMER_CFG_PERIODIC_UP);
+    TimerLoadSet64(CLOCK_TIMER_BASE, UINT64_MAX);
+    TimerEnable(CLOCK_TIMER_BASE, CLOCK_TIMER);
+}
+
+uint64_t MonotonicTicks(void) {
+    /*
+     * TimerValueGet64() rereads the upper half so a carry between the two
+     * reads cannot tear the value.
+     */
+    return TimerValueGet64(CLOCK_TIMER_BASE);
+}
+
+uint32_t GetClockFrequency(void) {
+    return ticks_per_second;
+}
+
+uint32_t TicksSince(uint64_t timestamp) {
+    uint64_t elapsed = MonotonicTicks() - timestamp;
+    return (elapsed > UINT32_MAX) ? UINT32_MAX : (uint32_t) elapsed;
+}
+
+uint32_t TicksToMicros(uint32_t ticks) {
+    /*
+     * A 32-bit division, which the hardware does in a few cycles.
+     */
+    return ticks / ticks_per_us;
+}
+
+uint32_t MicrosToTicks(uint32_t micros) {
+    uint64_t ticks = (uint64_t) micros * ticks_per_us;
+    return (ticks > UINT32_MAX) ? UINT32_MAX : (uint32_t) ticks;
+}
+
+uint32_t MicrosSince(uint64_t timestamp) {
+    uint32_t ticks = TicksSince(timestamp);
+    return (ticks == UINT32_MAX) ? UINT32_MAX : TicksToMicros(ticks);
+}
@@ -0,0 +1,90 @@
+/**
+ * @file clock.h
+ *
+ * @brief Monotonic microsecond clock shared by the sensors and controllers.
+ */
+
+/**
+ * @defgroup clock_api Clock
+ * @{
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+/**
+ * A sensor reading and the time it was captured.
+ */
+typedef struct {
+    /**
+     * The reading.
+     */
+    int32_t value;
+
+    /**
+     * The time the reading was captured (system clock ticks).
+     * @see MonotonicTicks
+     */
+    uint64_t timestamp;
+} TimedSample;
+
+/**
+ * Initialise the monotonic clock. Must be called before any module which
+ * timestamps its samples is initialised.
+ */
+void ClockInit(void);
+
+/**
+ * Get the time since the clock was initialised. Runs at the system clock and
+ * keeps running while the processor sleeps. Never wraps in practice, and may
+ * be called from interrupt handlers. Timestamps are kept in ticks so the hot
+ * paths only do 32-bit arithmetic, and are converted to microseconds where
+ * they are reported.
+ *
+ * @return The time (system clock ticks).
+ */
+uint64_t MonotonicTicks(void);
+
+/**
+ * Get the frequency of the monotonic clock.
+ *
+ * @return The number of ticks per second.
+ */
+uint32_t GetClockFrequency(void);
+
+/**
+ * Get the number of ticks elapsed since a timestamp.
+ *
+ * @param timestamp A time returned by MonotonicTicks().
+ * @return The elapsed time (ticks), saturated to UINT32_MAX (53 s at 80 MHz).
+ */
+uint32_t TicksSince(uint64_t timestamp);
+
+/**
+ * Convert a tick count to microseconds.
+ *
+ * @param ticks The time (ticks).
+ * @return The time (us).
+ */
+uint32_t TicksToMicros(uint32_t ticks);
+
+/**
+ * Convert microseconds to a tick count.
+ *
+ * @param micros The time (us).
+ * @return The time (ticks), saturated to UINT32_MAX.
+ */
+uint32_t MicrosToTicks(uint32_t micros);
+
+/**
+ * Get the time elapsed since a timestamp.
+ *
+ * @param timestamp A time returned by MonotonicTicks().
+ * @return The elapsed time (us), or UINT32_MAX if it is too long to count in
+ * 32-bit ticks.
+ */
+uint32_t MicrosSince(uint64_t timestamp);
+
+#endif /* CLOCK_H_ */
+
+/** @} */
@@ -0,0 +1,112 @@
+/**
+ * @file filter.c
+ *
+ * @brief Fixed point streaming filters.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "driverlib/debug.h"
+
+#include "filter.h"
+
+void MovingAverageInit(MovingAverage *filter, int32_t *buffer, uint16_t length) {
+    ASSERT(length > 0);
+
+    filter->buffer = buffer;
+    filter->length = length;
+    MovingAverageReset(filter, 0);
+}
+
+void MovingAverageReset(MovingAverage *filter, int32_t value) {
+    for (uint16_t i = 0; i < filter->length; i++) {
+        filter->buffer[i] = value;
+    }
+    filter->sum = value * filter->length;
+    filter->index = 0;
+}
+
+int32_t MovingAverageUpdate(MovingAverage *filter, int32_t sample) {
+    /*
+     * Swap the oldest sample for the new one in the running sum.
+     */
+    filter->sum += sample - filter->buffer[filter->index];
+    filter->buffer[filter->index] = sample;
+    filter->index++;
+    if (filter->index == filter->length) {
+        filter->index = 0;
+    }
+    return filter->sum / filter->length;
+}
+
+void CicInit(Cic *filter, uint8_t order, uint8_t decimation_shift,
+        uint8_t fraction_bits) {
+    ASSERT(order > 0 && order <= CIC_MAX_ORDER);
+    ASSERT(order * decimation_shift >= fraction_bits);
+
+    for (uint8_t i = 0; i < CIC_MAX_ORDER; i++) {
+        filter->integrator[i] = 0;
+        filter->comb[i] = 0;
+    }
+    filter->order = order;
+    filter->decimation_shift = decimation_shift;
+    filter->output_shift = order * decimation_shift - fraction_bits;
+    filter->phase = 0;
+}
+
+bool CicUpdate(Cic *filter, int32_t sample, int32_t *output) {
+    /*
+     * Integrators run at the input rate. Unsigned arithmetic wraps, and the
+     * combs undo any wrap as long as the output fits in 32 bits.
+     */
+    uint32_t value = (uint32_t) sample;
+    for (uint8_t i = 0; i < filter->order; i++) {
+        filter->integrator[i] += value;
+        value = filter->integrator[i];
+    }
+
+    filter->phase++;
+    if (filter->phase < (1 << filter->decimation_shift)) {
+        return false;
+    }
+    filter->phase = 0;
+
+    /*
+     * Combs run at the output rate.
+     */
+    for (uint8_t i = 0; i < filter->order; i++) {
+        uint32_t previous = filter->comb[i];
+        filter->comb[i] = value;
+        value -= previous;
+    }
+    *output = (int32_t) value >> filter->output_shift;
+    return true;
+}
+
+void BiquadInit(Biquad *filter, const BiquadCoefficients *coefficients) {
+    filter->coefficients = coefficients;
+    BiquadReset(filter, 0);
+}
+
+void BiquadReset(Biquad *filter, int32_t value) {
+    filter->x1 = value;
+    filter->x2 = value;
+    filter->y1 = value;
+    filter->y2 = value;
+}
+
+int32_t BiquadUpdate(Biquad *filter, int32_t sample) {
+    const BiquadCoefficients *c = filter->coefficients;
+    int64_t accumulator = (int64_t) c->b0 * sample + (int64_t) c->b1 * filter->x1
+            + (int64_t) c->b2 * filter->x2 - (int64_t) c->a1 * filter->y1
+            - (int64_t) c->a2 * filter->y2;
+    int32_t output = (int32_t) ((accumulator + (1 << (BIQUAD_SHIFT - 1)))
+            >> BIQUAD_SHIFT);
+
+    filter->x2 = filter->x1;
+    filter->x1 = sample;
+    filter->y2 = filter->y1;
+    filter->y1 = output;
+    return output;
+}
@@ -0,0 +1,205 @@
+/**
+ * @file filter.h
+ *
+ * @brief Fixed point streaming filters.
+ */
+
+/**
+ * @defgroup filter_api Filter
+ *
+ * Fixed point streaming filters for sensor pipelines. Every filter does a
+ * constant amount of integer work per sample, whatever its length or order.
+ * @{
+ */
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+/*
+ * Largest supported CIC filter order.
+ */
+#define CIC_MAX_ORDER           4
+
+/*
+ * Fractional bits of the biquad coefficients.
+ */
+#define BIQUAD_SHIFT            28
+
+/**
+ * Convert a biquad coefficient to the fixed point representation.
+ */
+#define BIQUAD_COEFFICIENT(x)   ((int32_t) ((x) * (double) (1L << BIQUAD_SHIFT) + ((x) < 0 ? -0.5 : 0.5)))
+
+/**
+ * Initialiser for constant biquad coefficients, for the difference equation
+ * y = b0 x + b1 x[-1] + b2 x[-2] - a1 y[-1] - a2 y[-2].
+ */
+#define BIQUAD_COEFFICIENTS(b0, b1, b2, a1, a2) \
+        { BIQUAD_COEFFICIENT(b0), BIQUAD_COEFFICIENT(b1), \
+          BIQUAD_COEFFICIENT(b2), BIQUAD_COEFFICIENT(a1), \
+          BIQUAD_COEFFICIENT(a2) }
+
+/**
+ * A moving average over a running sum.
+ */
+typedef struct {
+    /**
+     * The last @p length samples.
+     */
+    int32_t *buffer;
+
+    /**
+     * The sum of the samples in the buffer.
+     */
+    int32_t sum;
+
+    /**
+     * The number of samples averaged.
+     */
+    uint16_t length;
+
+    /**
+     * The index of the oldest sample.
+     */
+    uint16_t index;
+} MovingAverage;
+
+/**
+ * A decimating cascaded integrator-comb filter with a power of two
+ * decimation.
+ */
+typedef struct {
+    /**
+     * The integrator and comb states. Wrap around is intended.
+     */
+    uint32_t integrator[CIC_MAX_ORDER];
+    uint32_t comb[CIC_MAX_ORDER];
+
+    /**
+     * The number of integrator and comb stages.
+     */
+    uint8_t order;
+
+    /**
+     * The decimation, as a power of two.
+     */
+    uint8_t decimation_shift;
+
+    /**
+     * The shift which removes the filter gain, less the fractional bits kept.
+     */
+    uint8_t output_shift;
+
+    /**
+     * The number of samples since the last output.
+     */
+    uint16_t phase;
+} Cic;
+
+/**
+ * The coefficients of a biquad section.
+ */
+typedef struct {
+    int32_t b0;
+    int32_t b1;
+    int32_t b2;
+    int32_t a1;
+    int32_t a2;
+} BiquadCoefficients;
+
+/**
+ * A direct form I biquad section.
+ */
+typedef struct {
+    /**
+     * The filter coefficients.
+     */
+    const BiquadCoefficients *coefficients;
+
+    /**
+     * The previous two inputs and outputs.
+     */
+    int32_t x1;
+    int32_t x2;
+    int32_t y1;
+    int32_t y2;
+} Biquad;
+
+/**
+ * Initialise a moving average.
+ *
+ * @param filter The filter.
+ * @param buffer Storage for @p length samples.
+ * @param length The number of samples to average.
+ */
+void MovingAverageInit(MovingAverage *filter, int32_t *buffer, uint16_t length);
+
+/**
+ * Fill a moving average with a value, as if it had been settled on it.
+ *
+ * @param filter The filter.
+ * @param value The value.
+ */
+void MovingAverageReset(MovingAverage *filter, int32_t value);
+
+/**
+ * Add a sample to a moving average.
+ *
+ * @param filter The filter.
+ * @param sample The new sample.
+ * @return The average of the last samples.
+ */
+int32_t MovingAverageUpdate(MovingAverage *filter, int32_t sample);
+
+/**
+ * Initialise a CIC filter. The gain of order * decimation_shift bits is
+ * removed from the output, except for @p fraction_bits which are kept as
+ * extra resolution.
+ *
+ * @param filter The filter.
+ * @param order The number of stages, up to CIC_MAX_ORDER.
+ * @param decimation_shift The decimation, as a power of two.
+ * @param fraction_bits The fractional bits of the output.
+ */
+void CicInit(Cic *filter, uint8_t order, uint8_t decimation_shift,
+        uint8_t fraction_bits);
+
+/**
+ * Add a sample to a CIC filter.
+ *
+ * @param filter The filter.
+ * @param sample The new sample.
+ * @param output Set to the decimated output when one is ready.
+ * @return true if an output is ready.
+ */
+bool CicUpdate(Cic *filter, int32_t sample, int32_t *output);
+
+/**
+ * Initialise a biquad section.
+ *
+ * @param filter The filter.
+ * @param coefficients The filter coefficients.
+ */
+void BiquadInit(Biquad *filter, const BiquadCoefficients *coefficients);
+
+/**
+ * Set a biquad section to its steady state for a constant input. Only exact
+ * for unity DC gain sections.
+ *
+ * @param filter The filter.
+ * @param value The input and output value.
+ */
+void BiquadReset(Biquad *filter, int32_t value);
+
+/**
+ * Add a sample to a biquad section.
+ *
+ * @param filter The filter.
+ * @param sample The new sample.
+ * @return The filtered sample.
+ */
+int32_t BiquadUpdate(Biquad *filter, int32_t sample);
+
+#endif /* FILTER_H_ */
+
+/** @} */
@@ -14,14 +14,21 @@
 #include "driverlib/timer.h"
 #include "utils/scheduler.h"
 
+#include "axis_controller.h"
 #include "buttons.h"
+#include "clock.h"
 #include "flight_controller.h"
 #include "height.h"
-#include "height_controller.h"
+#include "hover.h"
+#include "profile.h"
 #include "pwm.h"
 #include "switch.h"
 #include "yaw.h"
-#include "yaw_controller.h"
+
+#if CONTROL_TRIGGER == CONTROL_TRIGGER_PWM \
+        && CONTROL_FREQUENCY % PWM_FREQUENCY != 0
+#error "PWM_FREQUENCY must divide CONTROL_FREQUENCY"
+#endif
 
 /**
  * Forward declarations.
@@ -45,6 +52,11 @@ bool HasReachedTargetHeight(void);
 #define TIMER_TIMEOUT			TIMER_TIMA_TIMEOUT
 #define TIMER_INT				INT_TIMER0A
 
+/*
+ * Rate the height sampling is realigned to the PWM period boundary (Hz).
+ */
+#define PHASE_LOCK_FREQUENCY    1
+
 /*
  * Rate of descent (ms per decrement of duty cycle)
  */
@@ -88,17 +100,118 @@ static enum {
     LANDED, INIT, FLYING, LANDING
 } flight_state = LANDED;
 
+/*
+ * The published flight state. The sequence is odd while the snapshot is being
+ * written. There is a single writer on a single core, so volatile ordering is
+ * all the seqlock needs.
+ */
+static volatile FlightSnapshot snapshot;
+static volatile uint32_t snapshot_sequence = 0;
+
+static volatile bool control_enabled = false;
+static volatile uint32_t control_latency;
+static volatile uint32_t control_latency_max;
+
+/**
+ * Run the control law and record how old the height sample it used is.
+ */
+static void UpdateControllers(void) {
+    uint32_t latency = GetHeightSampleAge();
+    UpdateYawRate();
+    UpdateAxisControllers();
+    UpdatePwmShaping();
+    PwmCommit();
+
+    control_latency = latency;
+    if (latency > control_latency_max) {
+        control_latency_max = latency;
+    }
+}
+
+/**
+ * Copy a snapshot a word at a time, keeping the order of the volatile accesses.
+ */
+static inline void SnapshotCopy(volatile FlightSnapshot *to,
+        const volatile FlightSnapshot *from) {
+    volatile uint32_t *to_words = (volatile uint32_t *) to;
+    const volatile uint32_t *from_words = (const volatile uint32_t *) from;
+    for (uint32_t i = 0; i < sizeof(FlightSnapshot) / sizeof(uint32_t); i++) {
+        to_words[i] = from_words[i];
+    }
+}
+
+/**
+ * Publish the flight state for the foreground tasks.
+ */
+static void PublishSnapshot(void) {
+    FlightSnapshot next;
+    int32_t yaw = GetYaw();
+    int32_t target_yaw = GetAxisTargetRaw(AXIS_YAW);
+
+    next.timestamp = MonotonicTicks();
+    next.height = GetHeightPercentage();
+    next.target_height = GetAxisTarget(AXIS_HEIGHT);
+    next.yaw = yaw * 360 / YAW_FULL_ROTATION;
+    next.target_yaw = GetAxisTarget(AXIS_YAW);
+    next.yaw_raw = yaw;
+    next.target_yaw_raw = target_yaw;
+    next.yaw_rate = GetYawRate();
+    next.duty_cycle_main = GetPwmDutyCycle(MAIN_ROTOR);
+    next.duty_cycle_tail = GetPwmDutyCycle(TAIL_ROTOR);
+    next.latency = control_latency;
+    next.latency_max = control_latency_max;
+    next.height_age = GetHeightSampleAge();
+    next.yaw_age = GetYawSampleAge();
+
+    snapshot_sequence++;
+    SnapshotCopy(&snapshot, &next);
+    snapshot_sequence++;
+}
+
+void GetFlightSnapshot(FlightSnapshot *copy) {
+    uint32_t sequence;
+    do {
+        sequence = snapshot_sequence;
+        SnapshotCopy(copy, &snapshot);
+    } while ((sequence & 1) != 0 || sequence != snapshot_sequence);
+}
+
 void TimerHandler(void) {
+    uint32_t start = ProfileStart();
     TimerIntClear(TIMER_BASE, TIMER_TIMEOUT);
-    UpdateYawController(1000 / PWM_FREQUENCY);
-    UpdateHeightController(1000 / PWM_FREQUENCY);
+    UpdateControllers();
+    ProfileEnd(PROFILE_TIMER_HANDLER, start);
+}
+
+/**
+ * Called from the ADC interrupt each time a new height block is available.
+ * The snapshot is published even while the controllers are disabled.
+ */
+static void HeightSampleHandler(void) {
+#if CONTROL_TRIGGER != CONTROL_TRIGGER_TIMER
+    if (control_enabled) {
+        UpdateControllers();
+    }
+#endif
+#if CONTROL_TRIGGER == CONTROL_TRIGGER_PWM
+    /*
+     * Realign periodically, so any drift between the sample timer and the
+     * PWM is corrected before it adds up.
+     */
+    static uint32_t phase_lock_ticks = 0;
+    if (++phase_lock_ticks >= CONTROL_FREQUENCY / PHASE_LOCK_FREQUENCY) {
+        phase_lock_ticks = 0;
+        PwmZeroCallbackArm();
+    }
+#endif
+    PublishSnapshot();
 }
 
 void TimerInit(void) {
+#if CONTROL_TRIGGER == CONTROL_TRIGGER_TIMER
     SysCtlPeripheralEnable(TIMER_PERIPH);
     TimerConfigure(TIMER_BASE, TIMER_CONFIG);
-    TimerLoadSet(TIMER_BASE, TIMER_TIMER, SysCtlClockGet() / PWM_FREQUENCY);
-
+    TimerLoadSet(TIMER_BASE, TIMER_TIMER, SysCtlClockGet() / CONTROL_FREQUENCY);
     TimerIntRegister(TIMER_BASE, TIMER_TIMER, TimerHandler);
 
     /*
@@ -107,16 +220,26 @@ void TimerInit(void) {
     IntEnable(TIMER_INT);
     TimerIntEnable(TIMER_BASE, TIMER_TIMEOUT);
 
-    /*
-     * Trigger ADC to capture height.
-     */
-    TimerADCEventSet(TIMER_BASE, TIMER_TIMEOUT);
-    TimerControlTrigger(TIMER_BASE, TIMER_TIMER, true);
-
     /*
      * Enable the timers.
      */
     TimerEnable(TIMER_BASE, TIMER_TIMER);
+#else
+    /*
+     * The controllers run from the ADC interrupt on each fresh height block.
+     */
+    control_enabled = true;
+#if CONTROL_TRIGGER == CONTROL_TRIGGER_PWM
+    /*
+     * Restart the height sampling at the next PWM period boundary, and again
+     * every PHASE_LOCK_FREQUENCY. Both timers divide the system clock into
+     * exact multiples of each other's period, so only the interrupt latency of
+     * each restart moves the phase.
+     */
+    PwmZeroCallbackRegister(HeightSamplingRestart);
+#endif
+#endif
+    HeightSampleCallbackRegister(HeightSampleHandler);
 }
 
 void PriorityTaskInit(void) {
@@ -124,28 +247,45 @@ void PriorityTaskInit(void) {
 }
 
 void PriorityTaskDisable(void) {
+#if CONTROL_TRIGGER == CONTROL_TRIGGER_TIMER
     TimerIntDisable(TIMER_BASE, TIMER_TIMEOUT);
+#else
+    control_enabled = false;
+#endif
 }
 
 void PriorityTaskEnable(void) {
+#if CONTROL_TRIGGER == CONTROL_TRIGGER_TIMER
     TimerIntEnable(TIMER_BASE, TIMER_TIMEOUT);
+#else
+    control_enabled = true;
+#endif
+}
+
+uint32_t GetControlLatency(void) {
+    return control_latency;
+}
+
+uint32_t GetControlLatencyMax(void) {
+    return control_latency_max;
 }
 
 void FlightControllerInit(void) {
     PwmInit();
-    SetTargetHeight(0);
-    SetTargetYawDegrees(0);
-    YawControllerInit();
-    HeightControllerInit();
+    SetAxisTarget(AXIS_HEIGHT, 0);
+    SetAxisTarget(AXIS_YAW, 0);
+    AxisControllerInit();
     PriorityTaskInit();
+    HoverInit();
     ResetError();
 }
 
 void UpdateError(void) {
     static uint32_t idx = 0;
-    uint16_t yaw_sample_err = abs(GetYaw() - GetTargetYaw());
-    uint16_t height_sample_err = abs(
-            GetHeightPercentage() - (int32_t) GetTargetHeight());
+    FlightSnapshot state;
+    GetFlightSnapshot(&state);
+    uint16_t yaw_sample_err = abs(state.yaw_raw - state.target_yaw_raw);
+    uint16_t height_sample_err = abs(state.height - state.target_height);
     yaw_error_buf[idx] = yaw_sample_err;
     height_error_buf[idx] = height_sample_err;
     idx = (idx + 1) % NUM_ERROR_SAMPLES;
@@ -195,14 +335,14 @@ void UpdateFlightMode() {
         break;
     }
     case INIT: {
-        if (YawRefFound()) {
+        if (wait_2 && YawRefFound()) {
             wait = false;
+            wait_2 = false;
             /*
              * Before entering the FLYING state must enable PWM, clear the pid controllers, and
              * enable the priority task scheduler.
              */
-            YawControllerInit();
-            HeightControllerInit();
+            AxisControllerInit();
             PwmEnable(MAIN_ROTOR);
             PwmEnable(TAIL_ROTOR);
             PriorityTaskEnable();
@@ -212,11 +352,20 @@ void UpdateFlightMode() {
              */
             flight_state = FLYING;
         } else if (!wait) {
+            /*
+             * Calibrate the zero height with the rotors stopped.
+             */
             wait = true;
-            YawRefTrigger();
             ZeroHeightTrigger();
             PriorityTaskDisable();
+        } else if (!wait_2 && HeightRefFound()) {
+            /*
+             * Spin up the main rotor to search for the reference yaw.
+             */
+            wait_2 = true;
+            YawRefTrigger();
             SetPwmDutyCycle(MAIN_ROTOR, 25);
+            PwmCommit();
             PwmEnable(MAIN_ROTOR);
         }
         break;
@@ -229,6 +378,8 @@ void UpdateFlightMode() {
              */
             flight_state = LANDING;
         } else {
+            UpdateHover();
+
             /*
              * Get all the button pushes
              */
@@ -242,51 +393,52 @@ void UpdateFlightMode() {
             if (presses[BTN_UP] > 0) {
                 /*
                  * If the helicopter is set to be at zero height, preload the integral
-                 * so the rise time is less long.
+                 * with the learnt hover duty cycle so the rise time is less long.
                  */
-                if (GetTargetHeight() == 0) {
-                    PreloadHeightController(20, height_inc);
+                if (GetAxisTarget(AXIS_HEIGHT) == 0) {
+                    PreloadAxisController(AXIS_HEIGHT, GetHoverDuty(),
+                            height_inc);
                 }
-                target_height = GetTargetHeight()
+                target_height = GetAxisTarget(AXIS_HEIGHT)
                         + presses[BTN_UP] * height_inc;
                 target_height =
                         (target_height > height_max) ?
                                 height_max : target_height;
-                SetTargetHeight(target_height);
+                SetAxisTarget(AXIS_HEIGHT, target_height);
             }
 
             /*
              * Decrease height
              */
             if (presses[BTN_DOWN] > 0) {
-                target_height = GetTargetHeight()
+                target_height = GetAxisTarget(AXIS_HEIGHT)
                         - presses[BTN_DOWN] * height_inc;
                 target_height =
                         (target_height < height_min) ?
                                 height_min : target_height;
-                SetTargetHeight(target_height);
+                SetAxisTarget(AXIS_HEIGHT, target_height);
             }
 
             /*
              * Ignore yaw commands if the helicopter is at 0 height
              */
-            if (GetTargetHeight() > 0) {
+            if (GetAxisTarget(AXIS_HEIGHT) > 0) {
                 /*
                  * Rotate counter-clockwise
                  */
                 if (presses[BTN_LEFT] > 0) {
-                    target_yaw = GetTargetYawDegrees()
+                    target_yaw = GetAxisTarget(AXIS_YAW)
                             - presses[BTN_LEFT] * yaw_inc;
-                    SetTargetYawDegrees(target_yaw);
+                    SetAxisTarget(AXIS_YAW, target_yaw);
                 }
 
                 /*
                  * Rotate clockwise
                  */
                 if (presses[BTN_RIGHT] > 0) {
-                    target_yaw = GetTargetYawDegrees()
+                    target_yaw = GetAxisTarget(AXIS_YAW)
                             + presses[BTN_RIGHT] * yaw_inc;
-                    SetTargetYawDegrees(target_yaw);
+                    SetAxisTarget(AXIS_YAW, target_yaw);
                 }
             }
         }
@@ -304,7 +456,7 @@ void UpdateFlightMode() {
              */
             wait = true;
             int32_t yaw_ref = GetClosestYawRef(target_yaw);
-            SetTargetYaw(yaw_ref);
+            SetAxisTargetRaw(AXIS_YAW, yaw_ref);
 
             /*
              * Reset the error mechanism used to detect if target yaw and height have been reached.
@@ -314,7 +466,7 @@ void UpdateFlightMode() {
         } else if (!wait_2 && is_target_yaw_reached) {
             wait_2 = true;
         } else {
-            if (GetTargetHeight() == 0) {
+            if (GetAxisTarget(AXIS_HEIGHT) == 0) {
                 /*
                  * If 10 seconds have elapsed since it reached target height go to LANDED state
                  * regardless of yaw.
@@ -322,11 +474,12 @@ void UpdateFlightMode() {
                 if (is_target_height_reached
                         && (is_target_yaw_reached
                                 || (SchedulerElapsedTicksGet(elapsed_ticks)
-                                        * (1000 / PWM_FREQUENCY) > 10000))) {
+                                        * (1000 / SCHEDULER_FREQUENCY) > 10000))) {
                     wait = false;
                     wait_2 = false;
                     PwmDisable(MAIN_ROTOR);
                     PwmDisable(TAIL_ROTOR);
+                    HoverSave();
                     /*
                      * Go to the LANDED state after disabling PWM
                      */
@@ -336,9 +489,9 @@ void UpdateFlightMode() {
             } else {
                 if (wait_2
                         && ((SchedulerElapsedTicksGet(elapsed_ticks)
-                                * (1000 / PWM_FREQUENCY)) >= RATE_OF_DESCENT)) {
+                                * (1000 / SCHEDULER_FREQUENCY)) >= RATE_OF_DESCENT)) {
                     elapsed_ticks = SchedulerTickCountGet();
-                    SetTargetHeight(GetTargetHeight() - 1);
+                    SetAxisTarget(AXIS_HEIGHT, GetAxisTarget(AXIS_HEIGHT) - 1);
                 }
             }
         }
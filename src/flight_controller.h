@@ -16,6 +16,129 @@
 #ifndef FLIGHT_CONTROLLER_H_
 #define FLIGHT_CONTROLLER_H_
 
+/*
+ * Control law triggers. The timer trigger runs the controllers from a timer
+ * timeout on the latest complete height block. The ADC trigger runs them from
+ * the ADC interrupt on the block that has just been filled. The PWM trigger
+ * does the same, with the height sampling started at a PWM period boundary so
+ * every control update lands at the same phase of the PWM period.
+ */
+#define CONTROL_TRIGGER_TIMER       0
+#define CONTROL_TRIGGER_ADC         1
+#define CONTROL_TRIGGER_PWM         2
+
+/*
+ * The control law trigger, one of CONTROL_TRIGGER_TIMER, CONTROL_TRIGGER_ADC
+ * or CONTROL_TRIGGER_PWM.
+ */
+#ifndef CONTROL_TRIGGER
+#define CONTROL_TRIGGER             CONTROL_TRIGGER_ADC
+#endif
+
+/*
+ * Rate of the inner yaw rate control loop (Hz). The control timer, height
+ * blocks and yaw rate estimate run at this rate.
+ */
+#define YAW_RATE_CONTROL_FREQUENCY  1000
+
+/*
+ * Rate of the outer yaw heading control loop (Hz). Must divide
+ * YAW_RATE_CONTROL_FREQUENCY.
+ */
+#define YAW_CONTROL_FREQUENCY       250
+
+/*
+ * Rate of the height control loop (Hz). Must divide
+ * YAW_RATE_CONTROL_FREQUENCY.
+ */
+#define HEIGHT_CONTROL_FREQUENCY    250
+
+/*
+ * Rate of the control timer (Hz).
+ */
+#define CONTROL_FREQUENCY           YAW_RATE_CONTROL_FREQUENCY
+
+#if CONTROL_FREQUENCY % HEIGHT_CONTROL_FREQUENCY != 0
+#error "HEIGHT_CONTROL_FREQUENCY must divide CONTROL_FREQUENCY"
+#endif
+
+#if CONTROL_FREQUENCY % YAW_CONTROL_FREQUENCY != 0
+#error "YAW_CONTROL_FREQUENCY must divide CONTROL_FREQUENCY"
+#endif
+
+/*
+ * Rate of the task scheduler tick (Hz).
+ */
+#define SCHEDULER_FREQUENCY         200
+
+/**
+ * A consistent copy of the flight state, published by the control interrupt
+ * once per control tick with all unit conversions already done.
+ */
+typedef struct {
+    /**
+     * The time the snapshot was published (system clock ticks).
+     */
+    uint64_t timestamp;
+
+    /**
+     * The height (%).
+     */
+    int32_t height;
+
+    /**
+     * The target height (%).
+     */
+    int32_t target_height;
+
+    /**
+     * The yaw (degrees).
+     */
+    int32_t yaw;
+
+    /**
+     * The target yaw (degrees).
+     */
+    int32_t target_yaw;
+
+    /**
+     * The yaw (notches).
+     */
+    int32_t yaw_raw;
+
+    /**
+     * The target yaw (notches).
+     */
+    int32_t target_yaw_raw;
+
+    /**
+     * The yaw rate (notches per second).
+     */
+    int32_t yaw_rate;
+
+    /**
+     * The main rotor duty cycle (%).
+     */
+    uint32_t duty_cycle_main;
+
+    /**
+     * The tail rotor duty cycle (%).
+     */
+    uint32_t duty_cycle_tail;
+
+    /**
+     * The control latency and its maximum since start up (us).
+     */
+    uint32_t latency;
+    uint32_t latency_max;
+
+    /**
+     * The age of the height and yaw samples (us).
+     */
+    uint32_t height_age;
+    uint32_t yaw_age;
+} FlightSnapshot;
+
 /**
  * Initialise the flight controller module.
  */
@@ -49,6 +172,30 @@ void PriorityTaskEnable(void);
  */
 void PriorityTaskDisable(void);
 
+/**
+ * Copy the latest flight state. Lock free; retries if the control interrupt
+ * publishes a new snapshot during the copy. Must not be called from the
+ * control interrupt.
+ *
+ * @param copy The copy of the flight state.
+ */
+void GetFlightSnapshot(FlightSnapshot *copy);
+
+/**
+ * Get the sensor-to-actuator latency of the last control update, measured
+ * from the newest height sample the controllers used to them running.
+ *
+ * @return The control latency (us).
+ */
+uint32_t GetControlLatency(void);
+
+/**
+ * Get the largest control latency seen since start up.
+ *
+ * @return The maximum control latency (us).
+ */
+uint32_t GetControlLatencyMax(void);
+
 #endif /* FLIGHT_CONTROLLER_H_ */
 
 /** @} */
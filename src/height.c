@@ -7,13 +7,23 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 
+#include "inc/hw_adc.h"
+#include "inc/hw_ints.h"
 #include "inc/hw_memmap.h"
 #include "driverlib/adc.h"
 #include "driverlib/gpio.h"
+#include "driverlib/interrupt.h"
 #include "driverlib/sysctl.h"
+#include "driverlib/timer.h"
+#include "driverlib/udma.h"
 
+#include "clock.h"
+#include "filter.h"
+#include "flight_controller.h"
 #include "height.h"
+#include "profile.h"
 
 /**
  * The ADC interrupt handler for the height sensor.
@@ -26,78 +36,519 @@ void AdcHandler(void);
 #define ADC_GPIO_BASE       GPIO_PORTE_BASE
 #define ADC_GPIO_PIN        GPIO_PIN_4
 #define ADC_BASE            ADC0_BASE
+#if HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_DMA
 #define ADC_SEQUENCE        3
+#define ADC_SEQUENCE_DEPTH  1
+#define ADC_SEQUENCE_FIFO   (ADC_BASE + ADC_O_SSFIFO3)
+#else
+#define ADC_SEQUENCE        0
+#define ADC_SEQUENCE_DEPTH  8
+#endif
 #define ADC_CHANNEL         ADC_CTL_CH9
 #define ADC_PERIPH_ADC      SYSCTL_PERIPH_ADC0
 #define ADC_PERIPH_GPIO     SYSCTL_PERIPH_GPIOE
 
-static uint32_t zero_reading;
-static bool ref_found = false;
-static volatile uint32_t adc_val;
+/*
+ * Second ADC definitions. ADC1 samples the same channel, delayed by half a
+ * conversion so its samples fall between those of ADC0. The phase delay is at
+ * most one conversion, so hardware oversampling is off in this mode: with it
+ * on, the sequence steps are several conversions apart and each ADC1 sample
+ * would land right after an ADC0 sample rather than midway between two.
+ */
+#if HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_DUAL
+#define ADC_COUNT           2
+#define ADC_SECOND_BASE     ADC1_BASE
+#define ADC_SECOND_PERIPH   SYSCTL_PERIPH_ADC1
+#define ADC_SECOND_PHASE    ADC_PHASE_180
+#define ADC_OVERSAMPLE      1
+#else
+#define ADC_COUNT           1
+#define ADC_OVERSAMPLE      4
+#endif
+
+/*
+ * Sample timer definitions.
+ */
+#define SAMPLE_TIMER_PERIPH SYSCTL_PERIPH_TIMER1
+#define SAMPLE_TIMER_BASE   TIMER1_BASE
+#define SAMPLE_TIMER        TIMER_A
+#define SAMPLE_TIMER_EVENT  TIMER_TIMA_TIMEOUT
+
+/*
+ * uDMA definitions.
+ */
+#define DMA_PERIPH          SYSCTL_PERIPH_UDMA
+#define DMA_CHANNEL         UDMA_CHANNEL_ADC3
+#define DMA_CONTROL         (UDMA_SIZE_16 | UDMA_SRC_INC_NONE | UDMA_DST_INC_16 \
+                             | UDMA_ARB_1)
+
+/*
+ * Mean rate the height sensor is sampled at (Hz). One block is filled per
+ * control tick. Only the uDMA backend spaces the samples evenly at this rate;
+ * the others convert them in bursts, see HEIGHT_ACQUISITION.
+ */
+#define HEIGHT_SAMPLE_FREQUENCY (CONTROL_FREQUENCY * HEIGHT_BLOCK_SIZE)
+
+/*
+ * Samples converted per trigger, one per sequence step on each ADC.
+ */
+#define HEIGHT_TRIGGER_SAMPLES  (ADC_SEQUENCE_DEPTH * ADC_COUNT)
+
+/*
+ * Rate the sequence is triggered at (Hz).
+ */
+#define HEIGHT_TRIGGER_FREQUENCY (HEIGHT_SAMPLE_FREQUENCY / HEIGHT_TRIGGER_SAMPLES)
+
+#if HEIGHT_BLOCK_SIZE % HEIGHT_TRIGGER_SAMPLES != 0
+#error "HEIGHT_BLOCK_SIZE must be a multiple of the samples per trigger"
+#endif
+
+/*
+ * Height filter pipeline. Each block is decimated to one sample per control
+ * tick by a CIC filter, then optionally smoothed by a moving average and a
+ * biquad section at the control rate. The pipeline runs with
+ * HEIGHT_FRACTION_BITS of extra resolution.
+ */
+#define HEIGHT_FRACTION_BITS    4
+#define HEIGHT_CIC_ORDER        2
+#define HEIGHT_BLOCK_SHIFT      4
+
+/*
+ * Length of the moving average stage (control ticks), or 0 to bypass it.
+ */
+#define HEIGHT_AVERAGE_LENGTH   0
+
+/*
+ * Whether to run the biquad stage.
+ */
+#define HEIGHT_BIQUAD_ENABLE    1
+
+#if (1 << HEIGHT_BLOCK_SHIFT) != HEIGHT_BLOCK_SIZE
+#error "HEIGHT_BLOCK_SHIFT must match HEIGHT_BLOCK_SIZE"
+#endif
+
+/*
+ * Butterworth low-pass at 100 Hz for a 1 kHz control rate. Regenerate when
+ * CONTROL_FREQUENCY changes.
+ */
+static const BiquadCoefficients height_biquad_coefficients =
+        BIQUAD_COEFFICIENTS(0.0674552739, 0.1349105478, 0.0674552739,
+                -1.1429805025, 0.4128015981);
+
+static Cic height_cic;
+#if HEIGHT_AVERAGE_LENGTH > 0
+static int32_t height_average_buffer[HEIGHT_AVERAGE_LENGTH];
+static MovingAverage height_average;
+#endif
+#if HEIGHT_BIQUAD_ENABLE
+static Biquad height_biquad;
+#endif
+
+/*
+ * Counts down the decimated outputs while the CIC filter fills. The first
+ * HEIGHT_CIC_ORDER - 1 outputs are discarded.
+ */
+static uint8_t height_warmup = HEIGHT_CIC_ORDER;
+
+#if HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_DMA
+/*
+ * The uDMA channel control table. Must be aligned to 1024 bytes.
+ */
+#if defined(__TI_COMPILER_VERSION__)
+#pragma DATA_ALIGN(dma_control_table, 1024)
+static uint8_t dma_control_table[1024];
+#else
+static uint8_t dma_control_table[1024] __attribute__((aligned(1024)));
+#endif
+
+/*
+ * Ping-pong sample blocks, filled by the uDMA from the sequence FIFO.
+ */
+static uint16_t blocks[2][HEIGHT_BLOCK_SIZE];
+static volatile uint8_t active_block = 0;
+#else
+/*
+ * The sample block, filled from the sequence FIFO by the ADC interrupt.
+ */
+static uint16_t block[HEIGHT_BLOCK_SIZE];
+static volatile uint8_t block_fill = 0;
+#endif
+
+/*
+ * Zero height calibration. HEIGHT_ZERO_SAMPLES filtered samples are
+ * collected and averaged, leaving out samples more than HEIGHT_ZERO_REJECT
+ * mean absolute deviations from the mean.
+ */
+#define HEIGHT_ZERO_SAMPLES     128
+#define HEIGHT_ZERO_REJECT      2
+
+static int32_t zero_samples[HEIGHT_ZERO_SAMPLES];
+static volatile uint16_t zero_count;
+
+/*
+ * Readings with HEIGHT_FRACTION_BITS.
+ */
+static int32_t zero_reading;
+static volatile bool zero_requested = false;
+static volatile bool ref_found = false;
+static volatile int32_t adc_val;
+static volatile uint64_t adc_timestamp;
+static void (*sample_callback)(void);
+
+
+/**
+ * Average the zero height samples, rejecting outliers.
+ */
+static int32_t ZeroReduce(void) {
+    int32_t sum = 0;
+    for (uint16_t i = 0; i < HEIGHT_ZERO_SAMPLES; i++) {
+        sum += zero_samples[i];
+    }
+    int32_t mean = sum / HEIGHT_ZERO_SAMPLES;
+
+    uint32_t deviation_sum = 0;
+    for (uint16_t i = 0; i < HEIGHT_ZERO_SAMPLES; i++) {
+        deviation_sum += abs(zero_samples[i] - mean);
+    }
+
+    /*
+     * Round the limit up so samples are kept when there is no deviation.
+     */
+    int32_t limit = (deviation_sum * HEIGHT_ZERO_REJECT + HEIGHT_ZERO_SAMPLES
+            - 1) / HEIGHT_ZERO_SAMPLES;
+    int32_t kept_sum = 0;
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < HEIGHT_ZERO_SAMPLES; i++) {
+        if (abs(zero_samples[i] - mean) <= limit) {
+            kept_sum += zero_samples[i];
+            kept++;
+        }
+    }
+    return (kept > 0) ? kept_sum / kept : mean;
+}
+
+/**
+ * Run a block through the filter pipeline.
+ *
+ * @param block The block.
+ * @param output Set to the filtered height sample, with HEIGHT_FRACTION_BITS.
+ * @return true once the pipeline has settled.
+ */
+static inline bool BlockFilter(const uint16_t *block, int32_t *output) {
+    int32_t sample = 0;
+    for (uint8_t i = 0; i < HEIGHT_BLOCK_SIZE; i++) {
+        CicUpdate(&height_cic, block[i], &sample);
+    }
+
+    /*
+     * Start the later stages settled on the first full CIC output.
+     */
+    if (height_warmup > 0) {
+        height_warmup--;
+        if (height_warmup > 0) {
+            return false;
+        }
+#if HEIGHT_AVERAGE_LENGTH > 0
+        MovingAverageReset(&height_average, sample);
+#endif
+#if HEIGHT_BIQUAD_ENABLE
+        BiquadReset(&height_biquad, sample);
+#endif
+    }
+
+#if HEIGHT_AVERAGE_LENGTH > 0
+    sample = MovingAverageUpdate(&height_average, sample);
+#endif
+#if HEIGHT_BIQUAD_ENABLE
+    sample = BiquadUpdate(&height_biquad, sample);
+#endif
+    *output = sample;
+    return true;
+}
+
+/**
+ * Filter a complete block into the height and run the sample callback.
+ */
+static void BlockComplete(const uint16_t *samples) {
+    int32_t sample;
+    if (!BlockFilter(samples, &sample)) {
+        return;
+    }
+    /*
+     * The interrupt follows straight on from the newest conversion.
+     */
+    adc_val = sample;
+    adc_timestamp = MonotonicTicks();
+
+    if (zero_requested) {
+        zero_samples[zero_count++] = sample;
+        if (zero_count == HEIGHT_ZERO_SAMPLES) {
+            zero_reading = ZeroReduce();
+            zero_requested = false;
+            ref_found = true;
+        }
+    }
+
+    if (sample_callback) {
+        sample_callback();
+    }
+}
+
+#if HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_DMA
+/**
+ * Hand a block back to the uDMA.
+ */
+static inline void BlockArm(uint8_t index) {
+    uint32_t select = (index == 0) ? UDMA_PRI_SELECT : UDMA_ALT_SELECT;
+    uDMAChannelTransferSet(DMA_CHANNEL | select, UDMA_MODE_PINGPONG,
+            (void *) ADC_SEQUENCE_FIFO, blocks[index], HEIGHT_BLOCK_SIZE);
+}
+
+/**
+ * Collect the samples of an ADC interrupt.
+ */
+static inline void AdcUpdate(void) {
+    ADCIntClear(ADC_BASE, ADC_SEQUENCE);
+
+    /*
+     * The uDMA stops the block it has filled and moves on to the other one.
+     */
+    uint8_t index = active_block;
+    uint32_t select = (index == 0) ? UDMA_PRI_SELECT : UDMA_ALT_SELECT;
+    if (uDMAChannelModeGet(DMA_CHANNEL | select) != UDMA_MODE_STOP) {
+        return;
+    }
+    active_block = index ^ 1;
+
+    BlockComplete(blocks[index]);
+    BlockArm(index);
+}
+#elif HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_FIFO
+static inline void AdcUpdate(void) {
+    uint32_t fifo[ADC_SEQUENCE_DEPTH];
 
-void AdcHandler(void) {
-    uint32_t adc_buf[1];
-    ADCSequenceDataGet(ADC_BASE, ADC_SEQUENCE, adc_buf);
     ADCIntClear(ADC_BASE, ADC_SEQUENCE);
-    adc_val = adc_buf[0];
+
+    /*
+     * Drain the whole sequence in one go.
+     */
+    int32_t count = ADCSequenceDataGet(ADC_BASE, ADC_SEQUENCE, fifo);
+    for (int32_t i = 0; i < count && block_fill < HEIGHT_BLOCK_SIZE; i++) {
+        block[block_fill++] = (uint16_t) fifo[i];
+    }
+
+    if (block_fill == HEIGHT_BLOCK_SIZE) {
+        block_fill = 0;
+        BlockComplete(block);
+    }
+}
+#else
+static inline void AdcUpdate(void) {
+    uint32_t fifo[ADC_SEQUENCE_DEPTH];
+    uint32_t fifo_second[ADC_SEQUENCE_DEPTH];
+
+    /*
+     * Only the delayed ADC interrupts, by which time the sequence on ADC0 has
+     * also completed.
+     */
+    ADCIntClear(ADC_SECOND_BASE, ADC_SEQUENCE);
+
+    int32_t count = ADCSequenceDataGet(ADC_BASE, ADC_SEQUENCE, fifo);
+    int32_t count_second = ADCSequenceDataGet(ADC_SECOND_BASE, ADC_SEQUENCE,
+            fifo_second);
+    if (count_second < count) {
+        count = count_second;
+    }
+
+    /*
+     * Interleave the two FIFOs in the order the samples were taken.
+     */
+    for (int32_t i = 0; i < count && block_fill < HEIGHT_BLOCK_SIZE; i++) {
+        block[block_fill++] = (uint16_t) fifo[i];
+        block[block_fill++] = (uint16_t) fifo_second[i];
+    }
+
+    if (block_fill == HEIGHT_BLOCK_SIZE) {
+        block_fill = 0;
+        BlockComplete(block);
+    }
+}
+#endif
+
+void AdcHandler(void) {
+    uint32_t start = ProfileStart();
+    AdcUpdate();
+    ProfileEnd(PROFILE_ADC_HANDLER, start);
+}
+
+void HeightSampleCallbackRegister(void (*callback)(void)) {
+    sample_callback = callback;
+}
+
+/**
+ * Get the sample timer load value. A periodic timer counts from the load value
+ * down to zero, so its period is one tick longer than the load value.
+ */
+static inline uint32_t SampleTimerLoad(void) {
+    return SysCtlClockGet() / HEIGHT_TRIGGER_FREQUENCY - 1;
+}
+
+/**
+ * Configure the height sequence of an ADC to be triggered by the sample timer.
+ *
+ * @param base The ADC base address.
+ */
+static void SequenceInit(uint32_t base) {
+    ADCSequenceDisable(base, ADC_SEQUENCE);
+    ADCSequenceConfigure(base, ADC_SEQUENCE, ADC_TRIGGER_TIMER, 0);
+#if ADC_SEQUENCE_DEPTH > 1
+    for (uint8_t step = 0; step < ADC_SEQUENCE_DEPTH - 1; step++) {
+        ADCSequenceStepConfigure(base, ADC_SEQUENCE, step, ADC_CHANNEL);
+    }
+#endif
+    ADCSequenceStepConfigure(base, ADC_SEQUENCE, ADC_SEQUENCE_DEPTH - 1,
+            ADC_CHANNEL | ADC_CTL_IE | ADC_CTL_END);
+    ADCHardwareOversampleConfigure(base, ADC_OVERSAMPLE);
+#if HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_DMA
+    ADCSequenceDMAEnable(base, ADC_SEQUENCE);
+#endif
+    ADCSequenceEnable(base, ADC_SEQUENCE);
 }
 
 void HeightManagerInit() {
     SysCtlPeripheralEnable(ADC_PERIPH_ADC);
+#if ADC_COUNT > 1
+    SysCtlPeripheralEnable(ADC_SECOND_PERIPH);
+#endif
     SysCtlPeripheralEnable(ADC_PERIPH_GPIO);
+    SysCtlPeripheralEnable(SAMPLE_TIMER_PERIPH);
 
     GPIOPinTypeADC(ADC_GPIO_BASE, ADC_GPIO_PIN);
 
-    ADCIntRegister(ADC_BASE, ADC_SEQUENCE, AdcHandler);
+    CicInit(&height_cic, HEIGHT_CIC_ORDER, HEIGHT_BLOCK_SHIFT,
+            HEIGHT_FRACTION_BITS);
+#if HEIGHT_AVERAGE_LENGTH > 0
+    MovingAverageInit(&height_average, height_average_buffer,
+            HEIGHT_AVERAGE_LENGTH);
+#endif
+#if HEIGHT_BIQUAD_ENABLE
+    BiquadInit(&height_biquad, &height_biquad_coefficients);
+#endif
+
+#if HEIGHT_ACQUISITION == HEIGHT_ACQUISITION_DMA
+    /*
+     * Move each conversion straight from the sequence FIFO into the active
+     * block, alternating between the two blocks.
+     */
+    SysCtlPeripheralEnable(DMA_PERIPH);
+    uDMAEnable();
+    uDMAControlBaseSet(dma_control_table);
+    uDMAChannelAttributeDisable(DMA_CHANNEL, UDMA_ATTR_ALL);
+    uDMAChannelControlSet(DMA_CHANNEL | UDMA_PRI_SELECT, DMA_CONTROL);
+    uDMAChannelControlSet(DMA_CHANNEL | UDMA_ALT_SELECT, DMA_CONTROL);
+    BlockArm(0);
+    BlockArm(1);
+    active_block = 0;
+    uDMAChannelEnable(DMA_CHANNEL);
+#endif
 
+    /*
+     * With the uDMA enabled the sequence only interrupts once a block is full,
+     * otherwise it interrupts once the last step is converted. With two ADCs
+     * only the delayed one interrupts.
+     */
+#if ADC_COUNT > 1
+    ADCPhaseDelaySet(ADC_SECOND_BASE, ADC_SECOND_PHASE);
+    SequenceInit(ADC_SECOND_BASE);
+    ADCIntRegister(ADC_SECOND_BASE, ADC_SEQUENCE, AdcHandler);
+    ADCIntClear(ADC_SECOND_BASE, ADC_SEQUENCE);
+    ADCIntEnable(ADC_SECOND_BASE, ADC_SEQUENCE);
+    SequenceInit(ADC_BASE);
+#else
+    ADCIntRegister(ADC_BASE, ADC_SEQUENCE, AdcHandler);
     ADCIntClear(ADC_BASE, ADC_SEQUENCE);
     ADCIntEnable(ADC_BASE, ADC_SEQUENCE);
+    SequenceInit(ADC_BASE);
+#endif
 
-    /* Set to timer trigger for periodic height reading. */
-    ADCSequenceDisable(ADC_BASE, ADC_SEQUENCE);
-    ADCSequenceConfigure(ADC_BASE, ADC_SEQUENCE, ADC_TRIGGER_TIMER, 0);
-    ADCSequenceStepConfigure(ADC_BASE, ADC_SEQUENCE, 0,
-            ADC_CHANNEL | ADC_CTL_IE | ADC_CTL_END);
-    ADCHardwareOversampleConfigure(ADC_BASE, 64);
-    ADCSequenceEnable(ADC_BASE, ADC_SEQUENCE);
+    /*
+     * Trigger the sequence on every sample timer timeout.
+     */
+    TimerConfigure(SAMPLE_TIMER_BASE, TIMER_CFG_PERIODIC);
+    TimerLoadSet(SAMPLE_TIMER_BASE, SAMPLE_TIMER, SampleTimerLoad());
+    TimerADCEventSet(SAMPLE_TIMER_BASE, SAMPLE_TIMER_EVENT);
+    TimerControlTrigger(SAMPLE_TIMER_BASE, SAMPLE_TIMER, true);
+    TimerEnable(SAMPLE_TIMER_BASE, SAMPLE_TIMER);
 }
 
-void ZeroHeightTrigger(void) {
-    /* Set to manual trigger so we can get a zero height reading. */
-    ADCSequenceDisable(ADC_BASE, ADC_SEQUENCE);
-    ADCSequenceConfigure(ADC_BASE, ADC_SEQUENCE, ADC_TRIGGER_PROCESSOR, 0);
-    ADCSequenceEnable(ADC_BASE, ADC_SEQUENCE);
-
-    ADCIntDisable(ADC_BASE, ADC_SEQUENCE);
-    ADCIntClear(ADC_BASE, ADC_SEQUENCE);
-
-    ADCProcessorTrigger(ADC_BASE, ADC_SEQUENCE);
-    while (!ADCIntStatus(ADC_BASE, ADC_SEQUENCE, false)) {
-    }
-    ADCSequenceDataGet(ADC_BASE, ADC_SEQUENCE, &zero_reading);
-    adc_val = zero_reading;
-    ref_found = true;
+void HeightSamplingRestart(void) {
+    TimerDisable(SAMPLE_TIMER_BASE, SAMPLE_TIMER);
+    TimerLoadSet(SAMPLE_TIMER_BASE, SAMPLE_TIMER, SampleTimerLoad());
+    TimerEnable(SAMPLE_TIMER_BASE, SAMPLE_TIMER);
+}
 
-    /* Set back to timer trigger for periodic height reading. */
-    ADCSequenceDisable(ADC_BASE, ADC_SEQUENCE);
-    ADCSequenceConfigure(ADC_BASE, ADC_SEQUENCE, ADC_TRIGGER_TIMER, 0);
-    ADCSequenceEnable(ADC_BASE, ADC_SEQUENCE);
+void ZeroHeightTrigger(void) {
+    /*
+     * The ADC interrupt collects the samples and sets the reference.
+     */
+    ref_found = false;
+    zero_count = 0;
+    zero_requested = true;
+}
 
-    ADCIntEnable(ADC_BASE, ADC_SEQUENCE);
+bool HeightRefFound(void) {
+    return ref_found;
 }
 
-int32_t GetHeight() {
+/**
+ * Convert a filtered reading to a height above the zero reference.
+ */
+static inline int32_t HeightFromReading(int32_t reading) {
     if (ref_found) {
-        return (int32_t) zero_reading - adc_val;
+        int32_t height = zero_reading - reading;
+        return (height + (1 << (HEIGHT_FRACTION_BITS - 1)))
+                >> HEIGHT_FRACTION_BITS;
     } else {
         return 0;
     }
 }
 
+int32_t GetHeight() {
+    return HeightFromReading(adc_val);
+}
+
+TimedSample GetHeightSample(void) {
+    TimedSample sample;
+    int32_t reading;
+
+    /*
+     * Retry if the ADC interrupt updated the sample while it was being read.
+     */
+    do {
+        sample.timestamp = adc_timestamp;
+        reading = adc_val;
+    } while (sample.timestamp != adc_timestamp);
+
+    sample.value = HeightFromReading(reading);
+    return sample;
+}
+
 int32_t GetHeightPercentage() {
     return GetHeight() * 100 / FULL_SCALE_RANGE;
 }
 
+uint32_t GetHeightSampleAge(void) {
+    return MicrosSince(adc_timestamp);
+}
+
 void UpdateHeight(void) {
+#if ADC_COUNT > 1
+    /*
+     * Hold ADC1 until ADC0 is triggered so the phase delay is kept.
+     */
+    ADCProcessorTrigger(ADC_SECOND_BASE, ADC_SEQUENCE | ADC_TRIGGER_WAIT);
+    ADCProcessorTrigger(ADC_BASE, ADC_SEQUENCE | ADC_TRIGGER_SIGNAL);
+#else
     ADCProcessorTrigger(ADC_BASE, ADC_SEQUENCE);
+#endif
 }
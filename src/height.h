@@ -16,6 +16,8 @@
 #ifndef HEIGHT_H_
 #define HEIGHT_H_
 
+#include "clock.h"
+
 /*
  * The range of the height sensor for a 100% height reading.
  *
@@ -23,6 +25,44 @@
  */
 #define FULL_SCALE_RANGE 993
 
+/*
+ * Height acquisition backends.
+ *
+ * The uDMA backend converts one sample per trigger on sequencer 3, so the
+ * samples are evenly spaced at HEIGHT_BLOCK_SIZE per control tick. It moves
+ * every conversion into ping-pong blocks and interrupts once per block. The
+ * CIC stage of the height filter averages each block over the whole control
+ * period, giving the sinc^2 rejection of rotor ripple it was designed for.
+ *
+ * The FIFO and dual backends convert bursts instead, and drain the FIFOs from
+ * the ADC interrupt. The FIFO backend converts eight samples back to back on
+ * sequencer 0 per trigger, about 32 us with 4x hardware oversampling, with two
+ * triggers per control tick. The dual backend does the same on both ADC
+ * modules without hardware oversampling, with ADC1 sampling half a conversion
+ * behind ADC0. It interleaves the two FIFOs into one burst of sixteen samples
+ * over about 8 us, with one trigger per control tick. A block then only spans
+ * its bursts, so the CIC stage averages conversion noise but not the ripple
+ * between bursts. That ripple is sampled and aliases into the height, leaving
+ * the biquad stage as the only filter against it.
+ */
+#define HEIGHT_ACQUISITION_DMA  0
+#define HEIGHT_ACQUISITION_FIFO 1
+#define HEIGHT_ACQUISITION_DUAL 2
+
+/*
+ * The height acquisition backend, one of HEIGHT_ACQUISITION_DMA,
+ * HEIGHT_ACQUISITION_FIFO or HEIGHT_ACQUISITION_DUAL.
+ */
+#ifndef HEIGHT_ACQUISITION
+#define HEIGHT_ACQUISITION HEIGHT_ACQUISITION_DMA
+#endif
+
+/*
+ * Number of samples collected into each block. Each block is
+ * filtered down to one height sample.
+ */
+#define HEIGHT_BLOCK_SIZE 16
+
 /**
  * Get the current height. Retrieve the sensor reading after it has been offset
  * the zeroed sensor reading.
@@ -44,17 +84,53 @@ int32_t GetHeightPercentage(void);
  */
 void UpdateHeight();
 
+/**
+ * Get the current height and the time its newest sample was captured.
+ *
+ * @return The height (ADC counts) and its timestamp.
+ */
+TimedSample GetHeightSample(void);
+
+/**
+ * Get the age of the newest sample in the current height.
+ *
+ * @return The sample age (us).
+ */
+uint32_t GetHeightSampleAge(void);
+
+/**
+ * Register a function to be called from the ADC interrupt each time a new
+ * height block is available.
+ *
+ * @param callback The function to call, or NULL to disable the callback.
+ */
+void HeightSampleCallbackRegister(void (*callback)(void));
+
 /**
  * Initialise the height sensor peripherals and ports.
  */
 void HeightManagerInit(void);
 
 /**
- * Trigger a zero height reading to be used as a reference for subsequent height
- * readings.
+ * Restart the sample timer so a sample period starts now. The block being
+ * filled keeps its samples.
+ */
+void HeightSamplingRestart(void);
+
+/**
+ * Start a zero height calibration to be used as a reference for subsequent
+ * height readings. Returns immediately; the height reads zero until the
+ * calibration is complete.
  */
 void ZeroHeightTrigger(void);
 
+/**
+ * Check if the zero height calibration is complete.
+ *
+ * @return true if the zero height reference has been found else false
+ */
+bool HeightRefFound(void);
+
 #endif /* HEIGHT_H_ */
 
 /** @} */
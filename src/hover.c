@@ -0,0 +1,123 @@
+/**
+ * @file hover.c
+ *
+ * @brief Learns the main rotor duty cycle needed to hover.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "driverlib/eeprom.h"
+#include "driverlib/sysctl.h"
+
+#include "axis_controller.h"
+#include "height.h"
+#include "hover.h"
+#include "pwm.h"
+
+/*
+ * EEPROM definitions.
+ */
+#define HOVER_PERIPH_EEPROM     SYSCTL_PERIPH_EEPROM0
+#define HOVER_EEPROM_ADDRESS    0x0000
+
+/*
+ * Identifies a stored hover record. Change when the record layout changes.
+ */
+#define HOVER_MAGIC             0x484F5602
+
+/*
+ * Fractional bits of the hover duty cycle estimate.
+ */
+#define HOVER_SHIFT             8
+
+/*
+ * The estimate moves 1 / 2^HOVER_FILTER_SHIFT of the way to each settled
+ * sample.
+ */
+#define HOVER_FILTER_SHIFT      4
+
+/*
+ * The helicopter is settled once the height has been within
+ * HOVER_SETTLE_ERROR (%) of a non-zero target for HOVER_SETTLE_UPDATES
+ * updates.
+ */
+#define HOVER_SETTLE_ERROR      2
+#define HOVER_SETTLE_UPDATES    20
+
+/*
+ * Change in the estimate (permille) before it is written back, to limit EEPROM
+ * wear.
+ */
+#define HOVER_SAVE_THRESHOLD    10
+
+/*
+ * The record stored in EEPROM. A multiple of 4 bytes long.
+ */
+typedef struct {
+    uint32_t magic;
+    int32_t duty;
+} HoverRecord;
+
+static bool eeprom_ready = false;
+static int32_t hover_duty = HOVER_DUTY_DEFAULT << HOVER_SHIFT;
+static int32_t saved_duty = HOVER_DUTY_DEFAULT << HOVER_SHIFT;
+static uint8_t settled_updates = 0;
+
+void HoverInit(void) {
+    SysCtlPeripheralEnable(HOVER_PERIPH_EEPROM);
+    while (!SysCtlPeripheralReady(HOVER_PERIPH_EEPROM)) {
+    }
+    eeprom_ready = (EEPROMInit() == EEPROM_INIT_OK);
+    if (!eeprom_ready) {
+        return;
+    }
+
+    HoverRecord record;
+    EEPROMRead((uint32_t *) &record, HOVER_EEPROM_ADDRESS, sizeof(record));
+    if (record.magic == HOVER_MAGIC && record.duty > 0
+            && record.duty < (PWM_DUTY_SCALE << HOVER_SHIFT)) {
+        hover_duty = record.duty;
+        saved_duty = record.duty;
+    }
+}
+
+void UpdateHover(void) {
+    int32_t target = GetAxisTarget(AXIS_HEIGHT);
+    if (target == 0
+            || abs(GetHeightPercentage() - target) > HOVER_SETTLE_ERROR) {
+        settled_updates = 0;
+        return;
+    }
+
+    if (settled_updates < HOVER_SETTLE_UPDATES) {
+        settled_updates++;
+        return;
+    }
+
+    /*
+     * Once settled the proportional and derivative terms are close to zero,
+     * so the integrator holds the hover duty cycle.
+     */
+    int32_t sample = GetAxisIntegral(AXIS_HEIGHT) << HOVER_SHIFT;
+    hover_duty += (sample - hover_duty) >> HOVER_FILTER_SHIFT;
+}
+
+void HoverSave(void) {
+    if (!eeprom_ready
+            || abs(hover_duty - saved_duty)
+                    < (HOVER_SAVE_THRESHOLD << HOVER_SHIFT)) {
+        return;
+    }
+
+    HoverRecord record = { HOVER_MAGIC, hover_duty };
+    if (EEPROMProgram((uint32_t *) &record, HOVER_EEPROM_ADDRESS,
+            sizeof(record)) == 0) {
+        saved_duty = hover_duty;
+    }
+}
+
+int32_t GetHoverDuty(void) {
+    return (hover_duty + (1 << (HOVER_SHIFT - 1))) >> HOVER_SHIFT;
+}
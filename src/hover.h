@@ -0,0 +1,51 @@
+/**
+ * @file hover.h
+ *
+ * @brief Learns the main rotor duty cycle needed to hover.
+ */
+
+/**
+ * @defgroup hover_api Hover
+ *
+ * Learns the main rotor duty cycle needed to hover from the height integrator
+ * whenever the helicopter settles at its target height. The estimate is kept
+ * in EEPROM so it survives resets and is used to preload the height
+ * controller on take off.
+ * @{
+ */
+
+#ifndef HOVER_H_
+#define HOVER_H_
+
+/*
+ * Hover duty cycle (permille) used until one has been learnt.
+ */
+#define HOVER_DUTY_DEFAULT      200
+
+/**
+ * Initialise the hover module and load the stored hover duty cycle.
+ */
+void HoverInit(void);
+
+/**
+ * Update the hover duty cycle estimate. Must be called periodically while
+ * flying.
+ */
+void UpdateHover(void);
+
+/**
+ * Store the hover duty cycle estimate if it has moved since it was last
+ * stored. Blocks while the EEPROM is written, so call it once landed.
+ */
+void HoverSave(void);
+
+/**
+ * Get the learnt hover duty cycle.
+ *
+ * @return The hover duty cycle (permille).
+ */
+int32_t GetHoverDuty(void);
+
+#endif /* HOVER_H_ */
+
+/** @} */
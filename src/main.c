@@ -18,17 +18,18 @@
 #include "utils/uartstdio.h"
 #include "utils/ustdlib.h"
 
+#include "axis_controller.h"
 #include "buttons.h"
+#include "clock.h"
 #include "flight_controller.h"
 #include "height.h"
-#include "height_controller.h"
 #include "oled_interface.h"
+#include "profile.h"
 #include "pwm.h"
 #include "reset.h"
 #include "serial_interface.h"
 #include "switch.h"
 #include "yaw.h"
-#include "yaw_controller.h"
 
 #ifdef DEBUG
 void __error__(char *pcFilename, uint32_t ui32Line) {
@@ -37,7 +38,13 @@ void __error__(char *pcFilename, uint32_t ui32Line) {
 }
 #endif
 
-#define SYSTICK_FREQUENCY PWM_FREQUENCY
+#define SYSTICK_FREQUENCY SCHEDULER_FREQUENCY
+
+/*
+ * Serial commands to print and clear the execution time profile.
+ */
+#define SERIAL_PROFILE_REPORT   'p'
+#define SERIAL_PROFILE_RESET    'r'
 
 /*
  * Register task function prototypes.
@@ -50,12 +57,22 @@ void UpdateSerial();
  */
 void Initialise(void);
 
+/*
+ * Every task is timed through ProfileTaskRun().
+ */
+static ProfiledTask profiled_tasks[] = {
+        [0] = { .function = UpdateButtons, .slot = PROFILE_BUTTONS },
+        [1] = { .function = UpdateSwitch, .slot = PROFILE_SWITCH },
+        [2] = { .function = UpdateFlightMode, .slot = PROFILE_FLIGHT_MODE },
+        [3] = { .function = UpdateSerial, .slot = PROFILE_SERIAL },
+        [4] = { .function = Draw, .slot = PROFILE_DRAW } };
+
 tSchedulerTask g_psSchedulerTable[] = {
-        [0] = { .bActive = true, .pfnFunction = UpdateButtons, .ui32FrequencyTicks = 2 },
-        [1] = { .bActive = true, .pfnFunction = UpdateSwitch, .ui32FrequencyTicks = 2 },
-        [2] = { .bActive = true, .pfnFunction = UpdateFlightMode, .ui32FrequencyTicks = 10 },
-        [3] = { .bActive = true, .pfnFunction = UpdateSerial, .ui32FrequencyTicks = 50 },
-        [4] = { .bActive = true, .pfnFunction = Draw, .ui32FrequencyTicks = 10 } };
+        [0] = { .bActive = true, .pfnFunction = ProfileTaskRun, .pvParam = &profiled_tasks[0], .ui32FrequencyTicks = 2 },
+        [1] = { .bActive = true, .pfnFunction = ProfileTaskRun, .pvParam = &profiled_tasks[1], .ui32FrequencyTicks = 2 },
+        [2] = { .bActive = true, .pfnFunction = ProfileTaskRun, .pvParam = &profiled_tasks[2], .ui32FrequencyTicks = 10 },
+        [3] = { .bActive = true, .pfnFunction = ProfileTaskRun, .pvParam = &profiled_tasks[3], .ui32FrequencyTicks = 50 },
+        [4] = { .bActive = true, .pfnFunction = ProfileTaskRun, .pvParam = &profiled_tasks[4], .ui32FrequencyTicks = 10 } };
 uint32_t g_ui32SchedulerNumTasks = 5;
 
 void Initialise(void) {
@@ -75,6 +92,8 @@ void Initialise(void) {
     SchedulerInit(SYSTICK_FREQUENCY);
     SysTickIntRegister(SchedulerSysTickIntHandler);
 
+    ClockInit();
+    ProfileInit();
     ResetInit();
     ButtonsInit();
     SwitchInit();
@@ -89,45 +108,85 @@ void Initialise(void) {
 }
 
 void Draw() {
-    int32_t height = GetHeightPercentage();
-    uint32_t target_height = GetTargetHeight();
-    int32_t yaw = GetYawDegrees();
-    int32_t target_yaw = GetTargetYawDegrees();
+    FlightSnapshot state;
+    GetFlightSnapshot(&state);
     char text_buffer[17];
     OledClearBuffer();
-    usnprintf(text_buffer, sizeof(text_buffer), "Alt: %d [%d]", height,
-            target_height);
+    usnprintf(text_buffer, sizeof(text_buffer), "Alt: %d [%d]", state.height,
+            state.target_height);
     OledStringDraw(text_buffer, 0, 0);
-    usnprintf(text_buffer, sizeof(text_buffer), "Yaw: %d [%d]", yaw,
-            target_yaw);
+    usnprintf(text_buffer, sizeof(text_buffer), "Yaw: %d [%d]", state.yaw,
+            state.target_yaw);
     OledStringDraw(text_buffer, 0, 1);
+    uint32_t load = GetCpuLoad();
+    usnprintf(text_buffer, sizeof(text_buffer), "CPU: %d.%d%%", load / 10,
+            load % 10);
+    OledStringDraw(text_buffer, 0, 2);
 }
 
 /**
- * Send heli info to UART.
+ * Send the execution time of each profile slot to UART.
+ */
+void SerialProfileReport(void) {
+    ProfileStats stats;
+
+    UARTprintf("Profile (cycles): n min mean p50 p99 max\n");
+    for (uint8_t i = 0; i < NUM_PROFILE_SLOTS; i++) {
+        GetProfileStats(i, &stats);
+        UARTprintf("%s: %u %u %u %u %u %u\n", GetProfileName(i), stats.count,
+                stats.min, stats.mean, stats.median, stats.p99, stats.max);
+    }
+    UARTprintf("\n");
+}
+
+/**
+ * Send heli info to UART, or the profile if it has been requested.
  */
 void UpdateSerial() {
-    int32_t height = GetHeightPercentage();
-    uint32_t target_height = GetTargetHeight();
-    int32_t yaw = GetYawDegrees();
-    int32_t target_yaw = GetTargetYawDegrees();
-    uint32_t duty_cycle_main = GetPwmDutyCycle(MAIN_ROTOR);
-    uint32_t duty_cycle_tail = GetPwmDutyCycle(TAIL_ROTOR);
+    int32_t command = SerialCharGet();
+    if (command == SERIAL_PROFILE_REPORT) {
+        SerialProfileReport();
+        return;
+    } else if (command == SERIAL_PROFILE_RESET) {
+        ResetProfile();
+    }
+
+    FlightSnapshot state;
+    GetFlightSnapshot(&state);
     const char *flight_mode = GetFlightMode();
+    uint32_t glitch_spurious = GetYawGlitchCount(YAW_GLITCH_SPURIOUS);
+    uint32_t glitch_skipped = GetYawGlitchCount(YAW_GLITCH_SKIPPED);
+    uint32_t glitch_filtered = GetYawGlitchCount(YAW_GLITCH_FILTERED);
+    uint32_t edge_interval = GetYawEdgeIntervalMin();
+    uint32_t load = GetCpuLoad();
 
     UARTprintf("Alt: %d [%d]\n"
             "Yaw: %d [%d]\n"
             "Main: [%d] Tail: [%d]\n"
             "Mode: %s\n"
-            "\n", height, target_height, yaw, target_yaw, duty_cycle_main,
-            duty_cycle_tail, flight_mode);
+            "Latency: %d [%d] us\n"
+            "Age: Alt %d Yaw %d us\n"
+            "Glitch: %u %u %u Edge: %u us\n"
+            "CPU: %d.%d%%\n"
+            "\n", state.height, state.target_height, state.yaw,
+            state.target_yaw, state.duty_cycle_main, state.duty_cycle_tail,
+            flight_mode, state.latency, state.latency_max, state.height_age,
+            state.yaw_age, glitch_spurious, glitch_skipped, glitch_filtered,
+            edge_interval, load / 10, load % 10);
 }
 
 int main(void) {
     Initialise();
     IntMasterEnable();
 
+    /*
+     * Every task is due on a SysTick, so once the scheduler has run the due
+     * tasks there is nothing to do until the next tick. A tick taken while
+     * the scheduler ran stops the sleep.
+     */
     while (1) {
+        uint32_t tick = SchedulerTickCountGet();
         SchedulerRun();
+        ProfileSleep(tick);
     }
 }
@@ -4,32 +4,233 @@
  * @brief Generic pid controller module.
  */
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "pid.h"
 
 void PidInit(PidState *state) {
     state->error_previous = 0;
-    state->error_integrated = 0;
+    state->measurement_previous = 0;
+    state->derivative = 0;
+    state->integral = 0;
+    state->primed = false;
 }
 
-void PreloadPid(PidState *state, int32_t integral_preload) {
-    state->error_previous = 0;
-    state->error_integrated = integral_preload;
+void PidGainsSet(PidGains *gains, float proportional_gain, float integral_gain,
+        float derivative_gain) {
+    gains->proportional = PID_GAIN(proportional_gain);
+    gains->integral = PID_INTEGRAL_GAIN(integral_gain);
+    gains->derivative = PID_DERIVATIVE_GAIN(derivative_gain);
 }
 
-int32_t UpdatePid(PidState *state, int32_t error, uint32_t delta_t,
-        double proportional_gain, double integral_gain, double derivative_gain) {
+void PidGainsTune(PidGains *gains, float ultimate_gain, float ultimate_period) {
+    float proportional_gain = ultimate_gain / PID_TUNING_GAIN_RATIO;
+    PidGainsSet(gains, proportional_gain,
+            proportional_gain / (ultimate_period * PID_TUNING_INTEGRAL_RATIO),
+            proportional_gain * ultimate_period / PID_TUNING_DERIVATIVE_RATIO);
+}
 
-    state->error_integrated += (int32_t) delta_t * error;
-    int32_t error_integrated = state->error_integrated;
-    double error_derivative = (double) (error - state->error_previous)
-            / delta_t;
+#if PID_KERNEL == PID_KERNEL_FIXED
 
+/**
+ * Interpolate a single gain.
+ */
+static inline PidGain InterpolateGain(PidGain lower, PidGain upper,
+        uint32_t weight) {
+    return lower + (PidGain) (((int64_t) (upper - lower) * weight)
+            >> PID_WEIGHT_SHIFT);
+}
+
+/**
+ * The derivative term in Q16.16.
+ */
+static inline int64_t DerivativeTerm(PidGain gain, PidRate rate) {
+    return ((int64_t) gain * rate)
+            >> (PID_FIXED_DERIVATIVE_SHIFT + PID_FIXED_RATE_SHIFT
+                    - PID_FIXED_SHIFT);
+}
+
+void PidBumplessTransfer(PidState *state, const PidGains *from,
+        const PidGains *to) {
+    int64_t difference = (int64_t) (from->proportional - to->proportional)
+            * state->error_previous
+            - DerivativeTerm(from->derivative - to->derivative,
+                    state->derivative);
+    state->integral += difference
+            * ((int64_t) 1 << (PID_FIXED_INTEGRAL_SHIFT - PID_FIXED_SHIFT));
+}
+
+void PreloadPid(PidState *state, const PidGains *gains, int32_t control,
+        int32_t error) {
+    int64_t proportional_control = ((int64_t) gains->proportional * error)
+            >> PID_FIXED_SHIFT;
     state->error_previous = error;
+    state->integral = (control - proportional_control)
+            * ((int64_t) 1 << PID_FIXED_INTEGRAL_SHIFT);
+}
+
+int32_t PidIntegralGet(const PidState *state) {
+    return (int32_t) (state->integral >> PID_FIXED_INTEGRAL_SHIFT);
+}
+
+int32_t UpdatePid(PidState *state, int32_t target, int32_t measurement,
+        int32_t feedforward, uint32_t delta_t, const PidGains *gains,
+        const PidLimits *limits, const PidLimits *reach) {
+    int32_t error = target - measurement;
+
+    if (!state->primed) {
+        state->measurement_previous = measurement;
+        state->primed = true;
+    }
+
+    /*
+     * Measurement rate using the hardware 32-bit divider, smoothed by a
+     * first-order filter.
+     */
+    int32_t measurement_delta = measurement - state->measurement_previous;
+    measurement_delta = (measurement_delta > PID_RATE_LIMIT) ? PID_RATE_LIMIT :
+                        (measurement_delta < -PID_RATE_LIMIT) ? -PID_RATE_LIMIT :
+                        measurement_delta;
+    int32_t rate = (measurement_delta << PID_FIXED_RATE_SHIFT)
+            / (int32_t) delta_t;
+    state->derivative += (rate - state->derivative)
+            >> PID_DERIVATIVE_FILTER_SHIFT;
+
+    state->error_previous = error;
+    state->measurement_previous = measurement;
+
+    int64_t output_min = (int64_t) reach->output_min << PID_FIXED_SHIFT;
+    int64_t output_max = (int64_t) reach->output_max << PID_FIXED_SHIFT;
+    int64_t control = ((int64_t) feedforward << PID_FIXED_SHIFT)
+            + (int64_t) gains->proportional * error
+            - DerivativeTerm(gains->derivative, state->derivative);
+    int64_t unsaturated = control
+            + (state->integral >> (PID_FIXED_INTEGRAL_SHIFT - PID_FIXED_SHIFT));
+
+    /*
+     * Conditional integration: hold the integrator while the output is
+     * saturated and the error would push it further into saturation.
+     */
+    if (!((unsaturated >= output_max && error > 0)
+            || (unsaturated <= output_min && error < 0))) {
+        int64_t integral_min = (int64_t) (limits->output_min - feedforward)
+                * ((int64_t) 1 << PID_FIXED_INTEGRAL_SHIFT);
+        int64_t integral_max = (int64_t) (limits->output_max - feedforward)
+                * ((int64_t) 1 << PID_FIXED_INTEGRAL_SHIFT);
+        int64_t integral = state->integral
+                + (int64_t) gains->integral * (error * (int32_t) delta_t);
+        state->integral = (integral > integral_max) ? integral_max :
+                          (integral < integral_min) ? integral_min : integral;
+    }
+
+    control += state->integral >> (PID_FIXED_INTEGRAL_SHIFT - PID_FIXED_SHIFT);
+    control = (control > output_max) ? output_max :
+              (control < output_min) ? output_min : control;
+    return (int32_t) (control >> PID_FIXED_SHIFT);
+}
+
+#else
+
+static inline PidGain InterpolateGain(PidGain lower, PidGain upper,
+        uint32_t weight) {
+    return lower + (upper - lower) * (float) weight * (1.0f / PID_WEIGHT_ONE);
+}
+
+void PidBumplessTransfer(PidState *state, const PidGains *from,
+        const PidGains *to) {
+    state->integral += (from->proportional - to->proportional)
+            * (float) state->error_previous
+            - (from->derivative - to->derivative) * state->derivative;
+}
+
+void PreloadPid(PidState *state, const PidGains *gains, int32_t control,
+        int32_t error) {
+    state->error_previous = error;
+    state->integral = (float) control - gains->proportional * (float) error;
+}
+
+int32_t PidIntegralGet(const PidState *state) {
+    return (int32_t) state->integral;
+}
+
+int32_t UpdatePid(PidState *state, int32_t target, int32_t measurement,
+        int32_t feedforward, uint32_t delta_t, const PidGains *gains,
+        const PidLimits *limits, const PidLimits *reach) {
+    int32_t error = target - measurement;
+
+    if (!state->primed) {
+        state->measurement_previous = measurement;
+        state->primed = true;
+    }
+
+    float rate = (float) (measurement - state->measurement_previous)
+            / (float) delta_t;
+    state->derivative += (rate - state->derivative)
+            * (1.0f / (1 << PID_DERIVATIVE_FILTER_SHIFT));
+
+    state->error_previous = error;
+    state->measurement_previous = measurement;
+
+    float output_min = (float) reach->output_min;
+    float output_max = (float) reach->output_max;
+    float control = (float) feedforward + gains->proportional * (float) error
+            - gains->derivative * state->derivative;
+    float unsaturated = control + state->integral;
+
+    /*
+     * Conditional integration: hold the integrator while the output is
+     * saturated and the error would push it further into saturation.
+     */
+    if (!((unsaturated >= output_max && error > 0)
+            || (unsaturated <= output_min && error < 0))) {
+        float integral = state->integral
+                + gains->integral * (float) (error * (int32_t) delta_t);
+        float integral_min = (float) (limits->output_min - feedforward);
+        float integral_max = (float) (limits->output_max - feedforward);
+        state->integral = (integral > integral_max) ? integral_max :
+                          (integral < integral_min) ? integral_min : integral;
+    }
+
+    control += state->integral;
+    control = (control > output_max) ? output_max :
+              (control < output_min) ? output_min : control;
+    return (int32_t) control;
+}
+
+#endif
+
+void PidGainsInterpolate(PidGains *gains, const PidGains *lower,
+        const PidGains *upper, uint32_t weight) {
+    gains->proportional = InterpolateGain(lower->proportional,
+            upper->proportional, weight);
+    gains->integral = InterpolateGain(lower->integral, upper->integral, weight);
+    gains->derivative = InterpolateGain(lower->derivative, upper->derivative,
+            weight);
+}
+
+uint32_t PidTablePosition(int32_t position, int32_t range, uint32_t size,
+        uint32_t *weight) {
+    position = (position < 0) ? 0 : (position > range) ? range : position;
+
+    /*
+     * Position within the table in units of 1/range of an entry.
+     */
+    uint32_t last = size - 1;
+    uint32_t scaled = (uint32_t) position * last;
+    uint32_t index = scaled / (uint32_t) range;
+    *weight = (scaled - index * (uint32_t) range) * PID_WEIGHT_ONE
+            / (uint32_t) range;
+    if (index == last) {
+        index--;
+        *weight = PID_WEIGHT_ONE;
+    }
+    return index;
+}
 
-    int32_t control = error * proportional_gain
-            + error_integrated * integral_gain
-            + error_derivative * derivative_gain;
-    return control;
+void PidGainsSchedule(PidGains *gains, const PidGains *table, uint32_t size,
+        int32_t position, int32_t range) {
+    uint32_t weight;
+    uint32_t index = PidTablePosition(position, range, size, &weight);
+    PidGainsInterpolate(gains, &table[index], &table[index + 1], weight);
 }
@@ -14,9 +14,166 @@
 #ifndef PID_H_
 #define PID_H_
 
+/*
+ * Pid kernel implementations. The float kernel uses the single-precision FPU,
+ * the fixed kernel uses Q16.16 gains with a saturating int64 integrator and
+ * never touches the FPU.
+ */
+#define PID_KERNEL_FLOAT            0
+#define PID_KERNEL_FIXED            1
+
+/*
+ * The pid kernel to build, one of PID_KERNEL_FLOAT or PID_KERNEL_FIXED.
+ */
+#ifndef PID_KERNEL
+#define PID_KERNEL                  PID_KERNEL_FLOAT
+#endif
+
+#if PID_KERNEL == PID_KERNEL_FIXED
+
+/*
+ * Fractional bits of the proportional gain (Q16.16) and of the control output
+ * while it is being summed.
+ */
+#define PID_FIXED_SHIFT             16
+
+/*
+ * Fractional bits of the derivative gain (Q24.8). Derivative gains per
+ * microsecond are large, so they trade fractional bits for range.
+ */
+#define PID_FIXED_DERIVATIVE_SHIFT  8
+
+/*
+ * Fractional bits of the error rate. The error difference between updates is
+ * clamped to PID_RATE_LIMIT so the shift cannot overflow.
+ */
+#define PID_FIXED_RATE_SHIFT        20
+#define PID_RATE_LIMIT              (INT32_MAX >> PID_FIXED_RATE_SHIFT)
+
+/*
+ * Fractional bits of the integral gain and integrator. Integral gains are
+ * several orders of magnitude smaller than one, so they need more fractional
+ * bits than Q16.16 to not be rounded away.
+ */
+#define PID_FIXED_INTEGRAL_SHIFT    40
+
+/**
+ * A pid gain in the kernel representation.
+ */
+typedef int32_t PidGain;
+
+/**
+ * The integrator in the kernel representation.
+ */
+typedef int64_t PidIntegral;
+
+/**
+ * A measurement rate in the kernel representation.
+ */
+typedef int32_t PidRate;
+
+/**
+ * Convert a proportional gain to the kernel representation.
+ */
+#define PID_GAIN(x)                 ((PidGain) ((x) * (float) (1L << PID_FIXED_SHIFT) + 0.5f))
+
+/**
+ * Convert a derivative gain to the kernel representation.
+ */
+#define PID_DERIVATIVE_GAIN(x)      ((PidGain) ((x) * (float) (1L << PID_FIXED_DERIVATIVE_SHIFT) + 0.5f))
+
+/**
+ * Convert an integral gain to the kernel representation.
+ */
+#define PID_INTEGRAL_GAIN(x)        ((PidGain) ((x) * (float) (1LL << PID_FIXED_INTEGRAL_SHIFT) + 0.5f))
+
+#else
+
+typedef float PidGain;
+typedef float PidIntegral;
+typedef float PidRate;
+
+#define PID_GAIN(x)                 ((PidGain) (x))
+#define PID_DERIVATIVE_GAIN(x)      ((PidGain) (x))
+#define PID_INTEGRAL_GAIN(x)        ((PidGain) (x))
+
+#endif
+
+/*
+ * The measurement derivative is smoothed by a first-order filter which moves
+ * 1 / 2^PID_DERIVATIVE_FILTER_SHIFT of the way to each new sample.
+ */
+#define PID_DERIVATIVE_FILTER_SHIFT 2
+
+/*
+ * Weight representing one when interpolating gains.
+ */
+#define PID_WEIGHT_SHIFT            8
+#define PID_WEIGHT_ONE              (1 << PID_WEIGHT_SHIFT)
+
+/**
+ * Initialiser for a constant set of pid gains.
+ */
+#define PID_GAINS(kp, ki, kd)       { PID_GAIN(kp), PID_INTEGRAL_GAIN(ki), PID_DERIVATIVE_GAIN(kd) }
+
+/*
+ * Tyreus-Luyben tuning rules, relating the pid gains to the ultimate gain and
+ * ultimate period of a loop.
+ */
+#define PID_TUNING_GAIN_RATIO       2.2f
+#define PID_TUNING_INTEGRAL_RATIO   2.2f
+#define PID_TUNING_DERIVATIVE_RATIO 6.3f
+
+/**
+ * Initialiser for the pid gains of a loop with the given ultimate gain and
+ * ultimate period (us), evaluated at build time.
+ */
+#define PID_TUNED_GAINS(ku, tu) \
+        PID_GAINS((ku) / PID_TUNING_GAIN_RATIO, \
+                (ku) / PID_TUNING_GAIN_RATIO / ((tu) * PID_TUNING_INTEGRAL_RATIO), \
+                (ku) / PID_TUNING_GAIN_RATIO * (tu) / PID_TUNING_DERIVATIVE_RATIO)
+
+/**
+ * The gains of a pid controller, in the kernel representation. Time is
+ * measured in microseconds, so the integral gain is per microsecond and the
+ * derivative gain is in microseconds.
+ */
+typedef struct {
+    /**
+     * The proportional gain.
+     */
+    PidGain proportional;
+
+    /**
+     * The integral gain.
+     */
+    PidGain integral;
+
+    /**
+     * The derivative gain.
+     */
+    PidGain derivative;
+} PidGains;
+
 /**
- * A structure to accumulate the error and store the previous error for use by
- * the pid controller.
+ * The range of the actuator driven by a pid controller. The output is clamped
+ * to this range and the integrator is stopped from winding up beyond it.
+ */
+typedef struct {
+    /**
+     * The minimum control output.
+     */
+    int32_t output_min;
+
+    /**
+     * The maximum control output.
+     */
+    int32_t output_max;
+} PidLimits;
+
+/**
+ * A structure to accumulate the error and store the previous measurement for
+ * use by the pid controller.
  */
 typedef struct {
     /**
@@ -25,9 +182,24 @@ typedef struct {
     int32_t error_previous;
 
     /**
-     * The accumulated error.
+     * The previous measurement.
      */
-    int32_t error_integrated;
+    int32_t measurement_previous;
+
+    /**
+     * The filtered measurement rate.
+     */
+    PidRate derivative;
+
+    /**
+     * The integral term, already scaled by the integral gain.
+     */
+    PidIntegral integral;
+
+    /**
+     * Whether the previous measurement is valid.
+     */
+    bool primed;
 } PidState;
 
 /**
@@ -39,27 +211,118 @@ typedef struct {
 void PidInit(PidState *state);
 
 /**
- * Preload the integral component of the pid state with a postitve or negative error
- * to reduce integration time.
+ * Set the pid gains from floating point values.
+ *
+ * @param gains The gains to set.
+ * @param proportional_gain The proportional gain constant.
+ * @param integral_gain The integral gain constant.
+ * @param derivative_gain The derivative gain constant.
+ */
+void PidGainsSet(PidGains *gains, float proportional_gain, float integral_gain,
+        float derivative_gain);
+
+/**
+ * Set the pid gains from the ultimate gain and period of the loop.
+ *
+ * @param gains The gains to set.
+ * @param ultimate_gain The proportional gain at which the loop oscillates.
+ * @param ultimate_period The period of the oscillation (us).
+ * @see PID_TUNED_GAINS
+ */
+void PidGainsTune(PidGains *gains, float ultimate_gain, float ultimate_period);
+
+/**
+ * Interpolate between two sets of pid gains.
+ *
+ * @param gains The interpolated gains.
+ * @param lower The gains at a weight of 0.
+ * @param upper The gains at a weight of PID_WEIGHT_ONE.
+ * @param weight The weight of @p upper, from 0 to PID_WEIGHT_ONE.
+ */
+void PidGainsInterpolate(PidGains *gains, const PidGains *lower,
+        const PidGains *upper, uint32_t weight);
+
+/**
+ * Find the pair of entries of a table with @p size entries spaced evenly from
+ * 0 to @p range which bracket @p position. Positions outside the range are
+ * clamped to its ends.
+ *
+ * @param position The position to look up.
+ * @param range The position of the last entry.
+ * @param size The number of table entries, at least two.
+ * @param weight The weight of the upper entry, from 0 to PID_WEIGHT_ONE.
+ * @return The index of the lower entry.
+ */
+uint32_t PidTablePosition(int32_t position, int32_t range, uint32_t size,
+        uint32_t *weight);
+
+/**
+ * Interpolate the gains at a position in a gain table.
+ *
+ * @param gains The interpolated gains.
+ * @param table The gain table, with entries spaced evenly from 0 to @p range.
+ * @param size The number of table entries, at least two.
+ * @param position The position to look up.
+ * @param range The position of the last entry.
+ * @see PidTablePosition
+ */
+void PidGainsSchedule(PidGains *gains, const PidGains *table, uint32_t size,
+        int32_t position, int32_t range);
+
+/**
+ * Move to new gains without a bump in the control output, by moving the
+ * difference in the proportional and derivative terms into the integrator.
  *
  * @param state The pid error state.
- * @param integral_preload The preload error.
+ * @param from The gains in use.
+ * @param to The new gains.
  */
-void PreloadPid(PidState *state, int32_t integral_preload);
+void PidBumplessTransfer(PidState *state, const PidGains *from,
+        const PidGains *to);
 
 /**
- * Update the pid controller loop.
+ * Preload the integral component of the pid state so the controller starts
+ * with @p control output at the given error.
  *
  * @param state The pid error state.
+ * @param gains The pid gains.
+ * @param control The desired control output.
  * @param error The current error.
- * @param delta_t The update period of the pid controller.
- * @param proportional_gain The proportional gain constant.
- * @param integral_gain The integral gain constant.
- * @param derivative_gain The derivative gain constant.
- * @return
  */
-int32_t UpdatePid(PidState *state, int32_t error, uint32_t delta_t,
-        double proportional_gain, double integral_gain, double derivative_gain);
+void PreloadPid(PidState *state, const PidGains *gains, int32_t control,
+        int32_t error);
+
+/**
+ * Get the integral term of the pid controller.
+ *
+ * @param state The pid error state.
+ * @return The integral term, in control units.
+ */
+int32_t PidIntegralGet(const PidState *state);
+
+/**
+ * Update the pid controller loop.
+ *
+ * The derivative acts on the filtered measurement rather than the error, so
+ * target steps do not kick the output. The output is clamped to @p reach, and
+ * the integrator only integrates while the output is not saturated in the
+ * direction of the error. The integrator never holds more than the output
+ * range left over by the feedforward.
+ *
+ * @param state The pid error state.
+ * @param target The target value.
+ * @param measurement The measured value.
+ * @param feedforward Control added to the pid terms before clamping.
+ * @param delta_t The update period of the pid controller (us).
+ * @param gains The pid gains.
+ * @param limits The output range, which bounds the integrator.
+ * @param reach The part of the output range the actuator can reach by the
+ * next update, or @p limits if it responds at once.
+ * @return The control output, within @p reach.
+ */
+int32_t UpdatePid(PidState *state, int32_t target, int32_t measurement,
+        int32_t feedforward, uint32_t delta_t, const PidGains *gains,
+        const PidLimits *limits, const PidLimits *reach);
 
 #endif /* PID_H_ */
 
@@ -0,0 +1,254 @@
+/**
+ * @file profile.c
+ *
+ * @brief Execution time profiling of the scheduler tasks and interrupt
+ * handlers with the DWT cycle counter.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "inc/hw_types.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "utils/scheduler.h"
+
+#include "clock.h"
+#include "profile.h"
+
+/*
+ * Data watchpoint and trace unit registers.
+ */
+#define DEMCR                   0xE000EDFC
+#define DEMCR_TRCENA            0x01000000
+#define DWT_CTRL                0xE0001000
+#define DWT_CTRL_CYCCNTENA      0x00000001
+#define DWT_CYCCNT              0xE0001004
+
+/*
+ * Each power of two of cycles is split into 2^PROFILE_SUB_BITS histogram
+ * buckets, enough buckets to cover every 32-bit time.
+ */
+#define PROFILE_SUB_BITS        2
+#define PROFILE_SUB_BUCKETS     (1 << PROFILE_SUB_BITS)
+#define PROFILE_NUM_BUCKETS     ((33 - PROFILE_SUB_BITS) << PROFILE_SUB_BITS)
+
+/*
+ * Percentiles reported in the summary (permille).
+ */
+#define PROFILE_MEDIAN          500
+#define PROFILE_P99             990
+
+/*
+ * Period the CPU load is averaged over (Hz).
+ */
+#define PROFILE_LOAD_FREQUENCY  1
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[PROFILE_NUM_BUCKETS];
+} ProfileSlotState;
+
+static ProfileSlotState slots[NUM_PROFILE_SLOTS];
+
+static const char *const slot_names[NUM_PROFILE_SLOTS] = {
+        [PROFILE_BUTTONS] = "Buttons",
+        [PROFILE_SWITCH] = "Switch",
+        [PROFILE_FLIGHT_MODE] = "Mode",
+        [PROFILE_SERIAL] = "Serial",
+        [PROFILE_DRAW] = "Draw",
+        [PROFILE_TIMER_HANDLER] = "TimerISR",
+        [PROFILE_ADC_HANDLER] = "AdcISR",
+        [PROFILE_YAW_HANDLER] = "YawISR" };
+
+/*
+ * Idle time accounting, only touched by the main loop.
+ */
+static uint64_t idle_ticks;
+static uint64_t load_window_start;
+static uint64_t load_window_idle;
+static uint32_t load_window_ticks;
+static uint32_t cpu_load;
+
+/**
+ * Get the position of the highest set bit of a non-zero value.
+ */
+static inline uint32_t HighestBit(uint32_t value) {
+    uint32_t bit = 0;
+    for (uint32_t shift = 16; shift > 0; shift >>= 1) {
+        if (value >> shift) {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+/**
+ * Get the histogram bucket of a time. Times below 2^(PROFILE_SUB_BITS + 1)
+ * have a bucket each, after which each power of two is split evenly.
+ */
+static inline uint32_t BucketIndex(uint32_t cycles) {
+    if (cycles < 2 * PROFILE_SUB_BUCKETS) {
+        return cycles;
+    }
+    uint32_t bit = HighestBit(cycles);
+    uint32_t shift = bit - PROFILE_SUB_BITS;
+    return ((shift + 1) << PROFILE_SUB_BITS)
+            + ((cycles >> shift) & (PROFILE_SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the largest time in a histogram bucket.
+ */
+static uint32_t BucketUpper(uint32_t index) {
+    if (index < 2 * PROFILE_SUB_BUCKETS) {
+        return index;
+    }
+    uint32_t shift = (index >> PROFILE_SUB_BITS) - 1;
+    uint32_t lower = (PROFILE_SUB_BUCKETS + (index & (PROFILE_SUB_BUCKETS - 1)))
+            << shift;
+    return lower + ((1u << shift) - 1);
+}
+
+/**
+ * Get the time below which a fraction of the runs of a slot completed.
+ */
+static uint32_t Percentile(const ProfileSlotState *slot, uint32_t permille) {
+    uint32_t rank = (uint32_t) (((uint64_t) slot->count * permille + 999)
+            / 1000);
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < PROFILE_NUM_BUCKETS; i++) {
+        seen += slot->histogram[i];
+        if (seen >= rank) {
+            uint32_t upper = BucketUpper(i);
+            return (upper < slot->max) ? upper : slot->max;
+        }
+    }
+    return slot->max;
+}
+
+void ProfileInit(void) {
+    HWREG(DEMCR) |= DEMCR_TRCENA;
+    HWREG(DWT_CYCCNT) = 0;
+    HWREG(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+
+    load_window_ticks = SysCtlClockGet() / PROFILE_LOAD_FREQUENCY;
+    load_window_start = MonotonicTicks();
+
+    ResetProfile();
+}
+
+uint32_t ProfileStart(void) {
+    return HWREG(DWT_CYCCNT);
+}
+
+void ProfileEnd(uint8_t slot, uint32_t start) {
+    /*
+     * The counter wraps every 53 s at 80 MHz, which the unsigned difference
+     * handles for any shorter section.
+     */
+    uint32_t cycles = HWREG(DWT_CYCCNT) - start;
+    ProfileSlotState *state = &slots[slot];
+
+    state->count++;
+    state->total += cycles;
+    if (cycles < state->min) {
+        state->min = cycles;
+    }
+    if (cycles > state->max) {
+        state->max = cycles;
+    }
+    state->histogram[BucketIndex(cycles)]++;
+}
+
+void ProfileTaskRun(void *task) {
+    const ProfiledTask *profiled = task;
+    uint32_t start = ProfileStart();
+    profiled->function();
+    ProfileEnd(profiled->slot, start);
+}
+
+void GetProfileStats(uint8_t slot, ProfileStats *stats) {
+    static ProfileSlotState copy;
+
+    /*
+     * The interrupt handler slots are updated behind our back, so take a
+     * consistent copy to summarise.
+     */
+    bool was_disabled = IntMasterDisable();
+    copy = slots[slot];
+    if (!was_disabled)
+        IntMasterEnable();
+
+    if (copy.count == 0) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    stats->count = copy.count;
+    stats->min = copy.min;
+    stats->mean = (uint32_t) (copy.total / copy.count);
+    stats->median = Percentile(&copy, PROFILE_MEDIAN);
+    stats->p99 = Percentile(&copy, PROFILE_P99);
+    stats->max = copy.max;
+}
+
+void ProfileSleep(uint32_t tick) {
+    /*
+     * Interrupts stay masked across the WFI so the wake up is timed before the
+     * interrupt which caused it runs, and a pending interrupt still wakes the
+     * processor. A SysTick taken while the scheduler ran is no longer
+     * pending, so check the tick count with interrupts masked and skip the
+     * sleep if a task may have become due. The sleep is timed on the
+     * monotonic clock, as the cycle counter may stop while the processor
+     * clock is gated.
+     */
+    bool was_disabled = IntMasterDisable();
+    if (SchedulerTickCountGet() != tick) {
+        if (!was_disabled)
+            IntMasterEnable();
+        return;
+    }
+    uint64_t start = MonotonicTicks();
+    SysCtlSleep();
+    uint64_t now = MonotonicTicks();
+    if (!was_disabled)
+        IntMasterEnable();
+
+    idle_ticks += now - start;
+    load_window_idle += now - start;
+
+    uint64_t elapsed = now - load_window_start;
+    if (elapsed >= load_window_ticks) {
+        cpu_load = PROFILE_LOAD_SCALE
+                - (uint32_t) (load_window_idle * PROFILE_LOAD_SCALE / elapsed);
+        load_window_start = now;
+        load_window_idle = 0;
+    }
+}
+
+uint64_t GetIdleTicks(void) {
+    return idle_ticks;
+}
+
+uint32_t GetCpuLoad(void) {
+    return cpu_load;
+}
+
+const char *GetProfileName(uint8_t slot) {
+    return slot_names[slot];
+}
+
+void ResetProfile(void) {
+    bool was_disabled = IntMasterDisable();
+    memset(slots, 0, sizeof(slots));
+    for (uint8_t i = 0; i < NUM_PROFILE_SLOTS; i++) {
+        slots[i].min = UINT32_MAX;
+    }
+    if (!was_disabled)
+        IntMasterEnable();
+}
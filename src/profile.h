@@ -0,0 +1,153 @@
+/**
+ * @file profile.h
+ *
+ * @brief Execution time profiling of the scheduler tasks and interrupt
+ * handlers with the DWT cycle counter.
+ */
+
+/**
+ * @defgroup profile_api Profile
+ * @{
+ */
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+/*
+ * Full scale of the CPU load (permille).
+ */
+#define PROFILE_LOAD_SCALE      1000
+
+/**
+ * The code sections which are timed. An interrupt handler's time includes any
+ * higher priority interrupts which preempt it.
+ */
+enum ProfileSlot {
+    PROFILE_BUTTONS,
+    PROFILE_SWITCH,
+    PROFILE_FLIGHT_MODE,
+    PROFILE_SERIAL,
+    PROFILE_DRAW,
+    PROFILE_TIMER_HANDLER,
+    PROFILE_ADC_HANDLER,
+    PROFILE_YAW_HANDLER,
+    /**
+     * The total number of profile slots.
+     */
+    NUM_PROFILE_SLOTS
+};
+
+/**
+ * A summary of the execution times of a slot. The percentiles are the upper
+ * edge of the histogram bucket they fall in, which is within 25% of the true
+ * value.
+ */
+typedef struct {
+    /**
+     * The number of timed runs.
+     */
+    uint32_t count;
+
+    /**
+     * The execution times (cycles).
+     */
+    uint32_t min;
+    uint32_t mean;
+    uint32_t median;
+    uint32_t p99;
+    uint32_t max;
+} ProfileStats;
+
+/**
+ * A scheduler task which is timed into a profile slot.
+ */
+typedef struct {
+    /**
+     * The task function.
+     */
+    void (*function)(void);
+
+    /**
+     * The profile slot to time the task into.
+     * @see ProfileSlot
+     */
+    uint8_t slot;
+} ProfiledTask;
+
+/**
+ * Enable the cycle counter. Must be called before any section is timed.
+ */
+void ProfileInit(void);
+
+/**
+ * Start timing a section.
+ *
+ * @return The start time to pass to ProfileEnd() (cycles).
+ */
+uint32_t ProfileStart(void);
+
+/**
+ * Finish timing a section and add it to its slot. Each slot must only be
+ * timed from one context.
+ *
+ * @param slot The profile slot.
+ * @param start The time returned by ProfileStart().
+ */
+void ProfileEnd(uint8_t slot, uint32_t start);
+
+/**
+ * Scheduler task function which runs and times a ProfiledTask. Register it
+ * with a pointer to the ProfiledTask as the task parameter.
+ *
+ * @param task The ProfiledTask to run.
+ */
+void ProfileTaskRun(void *task);
+
+/**
+ * Summarise the execution times of a slot since the last reset.
+ *
+ * @param slot The profile slot.
+ * @param stats The summary, all zero if the slot has not run.
+ */
+void GetProfileStats(uint8_t slot, ProfileStats *stats);
+
+/**
+ * Get the name of a slot for reporting.
+ *
+ * @param slot The profile slot.
+ * @return The name.
+ */
+const char *GetProfileName(uint8_t slot);
+
+/**
+ * Clear the execution times of every slot.
+ */
+void ResetProfile(void);
+
+/**
+ * Sleep until the next interrupt, counting the time asleep as idle. Call from
+ * the main loop after the scheduler has run. Returns at once if the scheduler
+ * has ticked since @p tick, as a task may then be due.
+ *
+ * @param tick The scheduler tick count read before the scheduler last ran.
+ */
+void ProfileSleep(uint32_t tick);
+
+/**
+ * Get the total time the processor has slept since initialisation.
+ *
+ * @return The idle time (system clock ticks).
+ */
+uint64_t GetIdleTicks(void);
+
+/**
+ * Get the fraction of time the processor was awake over the last complete
+ * load window.
+ *
+ * @return The CPU load (permille), or 0 before the first window completes.
+ */
+uint32_t GetCpuLoad(void);
+
+#endif /* PROFILE_H_ */
+
+/** @} */
@@ -8,12 +8,14 @@
 #include <stdbool.h>
 
 #include "inc/hw_memmap.h"
+#include "inc/hw_pwm.h"
 #include "driverlib/debug.h"
 #include "driverlib/gpio.h"
 #include "driverlib/pin_map.h"
 #include "driverlib/pwm.h"
 #include "driverlib/sysctl.h"
 
+#include "flight_controller.h"
 #include "pwm.h"
 
 /*
@@ -28,6 +30,8 @@
 #define PWM_MAIN_GPIO_BASE      GPIO_PORTC_BASE
 #define PWM_MAIN_GPIO_CONFIG    GPIO_PC5_M0PWM7
 #define PWM_MAIN_GPIO_PIN       GPIO_PIN_5
+#define PWM_MAIN_GEN_BIT        PWM_GEN_3_BIT
+#define PWM_MAIN_INT            PWM_INT_GEN_3
 
 /*
  * PWM Tail rotor definitions.
@@ -41,6 +45,7 @@
 #define PWM_TAIL_GPIO_BASE      GPIO_PORTF_BASE
 #define PWM_TAIL_GPIO_CONFIG    GPIO_PF1_M1PWM5
 #define PWM_TAIL_GPIO_PIN       GPIO_PIN_1
+#define PWM_TAIL_GEN_BIT        PWM_GEN_2_BIT
 
 /*
  * General PWM definitions.
@@ -48,12 +53,134 @@
 #define PWM_DIVIDER_CODE        SYSCTL_PWMDIV_16
 #define PWM_DIVIDER             16
 
+/*
+ * With synchronised updates the generators only load new compare values at
+ * counter zero after a global sync has been requested.
+ */
+#if PWM_SYNC_UPDATES
+#define PWM_GEN_MODE            (PWM_GEN_MODE_UP_DOWN | PWM_GEN_MODE_SYNC \
+                                 | PWM_GEN_MODE_GEN_SYNC_GLOBAL)
+#else
+#define PWM_GEN_MODE            (PWM_GEN_MODE_UP_DOWN | PWM_GEN_MODE_NO_SYNC)
+#endif
+
+/*
+ * Valid duty cycle range (permille).
+ */
+#define PWM_DUTY_MIN            20
+#define PWM_DUTY_MAX            980
+
+/*
+ * Number of entries in the thrust linearisation tables, spaced evenly from
+ * zero to full thrust.
+ */
+#define PWM_THRUST_POINTS       11
+
+/*
+ * Fraction bits of the slewed thrust, so slow slew rates still move.
+ */
+#define PWM_THRUST_SHIFT        8
+
+/*
+ * Actuator shaping of each rotor. A thrust command is slew limited on each
+ * control tick, then linearised to a duty cycle and lifted over the deadband.
+ * Slewing the thrust rather than the duty cycle keeps the limit in the units
+ * of the controllers, so they can see exactly what the rotor will reach.
+ */
+static const struct {
+    /**
+     * Duty cycle (permille) giving each thrust (permille), without the
+     * deadband.
+     */
+    int32_t linearisation[2][PWM_THRUST_POINTS];
+
+    /**
+     * Duty cycle (permille) below which the rotor does not produce thrust.
+     */
+    uint32_t deadband[2];
+
+    /**
+     * Fastest change in thrust (permille per second).
+     */
+    uint32_t slew_rate[2];
+} pwm_shaping = {
+    .linearisation = {
+        [MAIN_ROTOR] = { 0, 100, 200, 300, 400, 500, 600, 700, 800, 900, 1000 },
+        [TAIL_ROTOR] = { 0, 100, 200, 300, 400, 500, 600, 700, 800, 900, 1000 } },
+    .deadband = {
+        [MAIN_ROTOR] = 0,
+        [TAIL_ROTOR] = 0 },
+    .slew_rate = {
+        [MAIN_ROTOR] = 2000,
+        [TAIL_ROTOR] = 5000 }
+};
+
+/*
+ * Compare register driving each output. Both outputs are the B output of their
+ * generator.
+ */
+static volatile uint32_t * const pwm_compare[] = {
+    [MAIN_ROTOR] = (volatile uint32_t *) (PWM_MAIN_BASE + PWM_MAIN_GEN
+            + PWM_O_X_CMPB),
+    [TAIL_ROTOR] = (volatile uint32_t *) (PWM_TAIL_BASE + PWM_TAIL_GEN
+            + PWM_O_X_CMPB) };
+
+static const uint32_t pwm_base[] = {
+    [MAIN_ROTOR] = PWM_MAIN_BASE,
+    [TAIL_ROTOR] = PWM_TAIL_BASE };
+
+static const uint32_t pwm_outbit[] = {
+    [MAIN_ROTOR] = PWM_MAIN_OUTBIT,
+    [TAIL_ROTOR] = PWM_TAIL_OUTBIT };
+
+/*
+ * The generator period and the up/down counter load, in PWM clock ticks.
+ * Computed once at initialisation.
+ */
+static uint32_t pwm_period;
+static uint32_t pwm_load;
+
 static bool pwm_state[2];
+static uint32_t pwm_ticks[2];
+
+/*
+ * The thrust each output is slewing towards, the thrust it has reached and
+ * the largest step per control tick, with PWM_THRUST_SHIFT fraction bits. An
+ * output written directly is not shaped until its next thrust command.
+ */
+static uint32_t pwm_thrust_target[2];
+static uint32_t pwm_thrust[2];
+static uint32_t pwm_slew_step[2];
+static bool pwm_shaped[2];
+static void (*zero_callback)(void);
+
+/**
+ * Main rotor generator interrupt, at counter zero.
+ */
+static void PwmZeroHandler(void) {
+    PWMGenIntClear(PWM_MAIN_BASE, PWM_MAIN_GEN, PWM_INT_CNT_ZERO);
+
+    /*
+     * The callback is only wanted once per arming.
+     */
+    PWMGenIntTrigDisable(PWM_MAIN_BASE, PWM_MAIN_GEN, PWM_INT_CNT_ZERO);
+    if (zero_callback) {
+        zero_callback();
+    }
+}
 
 void PwmInit() {
     SysCtlPWMClockSet(PWM_DIVIDER_CODE);
 
-    uint32_t period = SysCtlClockGet() / PWM_DIVIDER / PWM_FREQUENCY;
+    pwm_period = SysCtlClockGet() / PWM_DIVIDER / PWM_FREQUENCY;
+    pwm_load = pwm_period / 2;
+    for (uint8_t i = 0; i < 2; i++) {
+        pwm_slew_step[i] = (pwm_shaping.slew_rate[i] << PWM_THRUST_SHIFT)
+                / CONTROL_FREQUENCY;
+        if (pwm_slew_step[i] == 0) {
+            pwm_slew_step[i] = 1;
+        }
+    }
 
     /* Initialise Main Rotor */
     SysCtlPeripheralEnable(PWM_MAIN_PERIPH_GPIO);
@@ -64,12 +191,11 @@ void PwmInit() {
 
     PwmDisable(MAIN_ROTOR);
 
-    PWMGenConfigure(PWM_MAIN_BASE, PWM_MAIN_GEN,
-            PWM_GEN_MODE_UP_DOWN | PWM_GEN_MODE_NO_SYNC);
-    PWMGenEnable(PWM_MAIN_BASE, PWM_MAIN_GEN);
-
-    PWMGenPeriodSet(PWM_MAIN_BASE, PWM_MAIN_GEN, period);
-    SetPwmDutyCycle(MAIN_ROTOR, 2);
+    PWMGenConfigure(PWM_MAIN_BASE, PWM_MAIN_GEN, PWM_GEN_MODE);
+    PWMGenPeriodSet(PWM_MAIN_BASE, PWM_MAIN_GEN, pwm_period);
+    SetPwmDutyPermille(MAIN_ROTOR, PWM_DUTY_MIN);
+    PWMGenIntRegister(PWM_MAIN_BASE, PWM_MAIN_GEN, PwmZeroHandler);
+    PWMIntEnable(PWM_MAIN_BASE, PWM_MAIN_INT);
 
     /* Initialise Tail Rotor */
     SysCtlPeripheralEnable(PWM_TAIL_PERIPH_GPIO);
@@ -80,47 +206,184 @@ void PwmInit() {
 
     PwmDisable(TAIL_ROTOR);
 
-    PWMGenConfigure(PWM_TAIL_BASE, PWM_TAIL_GEN,
-            PWM_GEN_MODE_UP_DOWN | PWM_GEN_MODE_NO_SYNC);
+    PWMGenConfigure(PWM_TAIL_BASE, PWM_TAIL_GEN, PWM_GEN_MODE);
+    PWMGenPeriodSet(PWM_TAIL_BASE, PWM_TAIL_GEN, pwm_period);
+    SetPwmDutyPermille(TAIL_ROTOR, PWM_DUTY_MIN);
+
+    /*
+     * Start both generators together so their periods stay in step, as they
+     * run from the same clock.
+     */
+    PwmCommit();
+    PWMGenEnable(PWM_MAIN_BASE, PWM_MAIN_GEN);
     PWMGenEnable(PWM_TAIL_BASE, PWM_TAIL_GEN);
+}
 
-    PWMGenPeriodSet(PWM_TAIL_BASE, PWM_TAIL_GEN, period);
-    SetPwmDutyCycle(TAIL_ROTOR, 2);
+void PwmCommit(void) {
+#if PWM_SYNC_UPDATES
+    PWMSyncUpdate(PWM_MAIN_BASE, PWM_MAIN_GEN_BIT);
+    PWMSyncUpdate(PWM_TAIL_BASE, PWM_TAIL_GEN_BIT);
+#endif
 }
 
-void SetPwmDutyCycle(uint8_t pwm_output, uint32_t duty_cycle) {
-    ASSERT(!(duty_cycle < 2 || duty_cycle > 98));
-    uint32_t period = SysCtlClockGet() / PWM_DIVIDER / PWM_FREQUENCY;
-    switch (pwm_output) {
-    case MAIN_ROTOR:
-        PWMPulseWidthSet(PWM_MAIN_BASE, PWM_MAIN_OUTNUM,
-                period * duty_cycle / 100);
-        break;
-    case TAIL_ROTOR:
-        PWMPulseWidthSet(PWM_TAIL_BASE, PWM_TAIL_OUTNUM,
-                period * duty_cycle / 100);
-        break;
+void PwmZeroCallbackRegister(void (*callback)(void)) {
+    zero_callback = callback;
+    PwmZeroCallbackArm();
+}
+
+void PwmZeroCallbackArm(void) {
+    PWMGenIntClear(PWM_MAIN_BASE, PWM_MAIN_GEN, PWM_INT_CNT_ZERO);
+    PWMGenIntTrigEnable(PWM_MAIN_BASE, PWM_MAIN_GEN, PWM_INT_CNT_ZERO);
+}
+
+uint32_t GetPwmPeriod(void) {
+    return pwm_period;
+}
+
+/**
+ * Write the pulse width of an output to its compare register.
+ */
+static inline void PwmCompareSet(uint8_t pwm_output, uint32_t ticks) {
+    ASSERT(ticks < pwm_period);
+
+    /*
+     * In up/down mode the output is high while the counter is below the
+     * compare value, which is the same as PWMPulseWidthSet() would write.
+     */
+    pwm_ticks[pwm_output] = ticks;
+    *pwm_compare[pwm_output] = pwm_load - ticks / 2;
+}
+
+void SetPwmDutyTicks(uint8_t pwm_output, uint32_t ticks) {
+    /*
+     * A direct write bypasses the shaping until the next thrust command.
+     */
+    pwm_shaped[pwm_output] = false;
+    PwmCompareSet(pwm_output, ticks);
+}
+
+uint32_t GetPwmDutyTicks(uint8_t pwm_output) {
+    return pwm_state[pwm_output] ? pwm_ticks[pwm_output] : 0;
+}
+
+void SetPwmDutyPermille(uint8_t pwm_output, uint32_t duty_cycle) {
+    ASSERT(duty_cycle >= PWM_DUTY_MIN && duty_cycle <= PWM_DUTY_MAX);
+    SetPwmDutyTicks(pwm_output, pwm_period * duty_cycle / PWM_DUTY_SCALE);
+}
+
+uint32_t GetPwmDutyPermille(uint8_t pwm_output) {
+    return GetPwmDutyTicks(pwm_output) * PWM_DUTY_SCALE / pwm_period;
+}
+
+/**
+ * Get the duty cycle (permille) giving a thrust (permille).
+ */
+static uint32_t DutyFromThrust(uint8_t pwm_output, uint32_t thrust) {
+    /*
+     * Interpolate the linearisation table.
+     */
+    const int32_t *table = pwm_shaping.linearisation[pwm_output];
+    uint32_t position = thrust * (PWM_THRUST_POINTS - 1);
+    uint32_t index = position / PWM_DUTY_SCALE;
+    if (index == PWM_THRUST_POINTS - 1) {
+        index--;
     }
+    int32_t fraction = (int32_t) (position - index * PWM_DUTY_SCALE);
+    int32_t duty = table[index]
+            + (table[index + 1] - table[index]) * fraction / PWM_DUTY_SCALE;
+
+    /*
+     * Any thrust starts at the edge of the deadband.
+     */
+    uint32_t deadband = pwm_shaping.deadband[pwm_output];
+    if (thrust > 0) {
+        duty = (int32_t) deadband
+                + duty * (int32_t) (PWM_DUTY_SCALE - deadband) / PWM_DUTY_SCALE;
+    }
+
+    return (duty < PWM_DUTY_MIN) ? PWM_DUTY_MIN :
+           (duty > PWM_DUTY_MAX) ? PWM_DUTY_MAX : (uint32_t) duty;
 }
 
-uint32_t GetPwmDutyCycle(uint8_t pwm_output) {
-    uint32_t duty_cycle;
-    uint32_t period = SysCtlClockGet() / PWM_DIVIDER / PWM_FREQUENCY;
-    if (pwm_state[pwm_output]) {
-        switch (pwm_output) {
-        case MAIN_ROTOR:
-            duty_cycle = PWMPulseWidthGet(PWM_MAIN_BASE, PWM_MAIN_OUTNUM) * 100
-                    / period;
-            break;
-        case TAIL_ROTOR:
-            duty_cycle = PWMPulseWidthGet(PWM_TAIL_BASE, PWM_TAIL_OUTNUM) * 100
-                    / period;
-            break;
+/**
+ * Get the thrust (permille) given by a duty cycle (permille), inverting
+ * DutyFromThrust().
+ */
+static uint32_t ThrustFromDuty(uint8_t pwm_output, uint32_t duty) {
+    uint32_t deadband = pwm_shaping.deadband[pwm_output];
+    if (duty <= deadband) {
+        return 0;
+    }
+    int32_t linear = (int32_t) ((duty - deadband) * PWM_DUTY_SCALE
+            / (PWM_DUTY_SCALE - deadband));
+
+    /*
+     * The table increases, so find the segment holding the duty cycle.
+     */
+    const int32_t *table = pwm_shaping.linearisation[pwm_output];
+    uint32_t index = 0;
+    while (index < PWM_THRUST_POINTS - 2 && linear > table[index + 1]) {
+        index++;
+    }
+    int32_t span = table[index + 1] - table[index];
+    int32_t fraction = (span > 0) ?
+            (linear - table[index]) * PWM_DUTY_SCALE / span : 0;
+    int32_t thrust = ((int32_t) index * PWM_DUTY_SCALE + fraction)
+            / (PWM_THRUST_POINTS - 1);
+    return (thrust < 0) ? 0 :
+           (thrust > PWM_DUTY_SCALE) ? PWM_DUTY_SCALE : (uint32_t) thrust;
+}
+
+void SetPwmThrust(uint8_t pwm_output, uint32_t thrust) {
+    ASSERT(thrust <= PWM_DUTY_SCALE);
+
+    if (!pwm_shaped[pwm_output]) {
+        pwm_thrust[pwm_output] = GetPwmThrust(pwm_output) << PWM_THRUST_SHIFT;
+        pwm_shaped[pwm_output] = true;
+    }
+    pwm_thrust_target[pwm_output] = thrust << PWM_THRUST_SHIFT;
+}
+
+uint32_t GetPwmThrust(uint8_t pwm_output) {
+    if (pwm_shaped[pwm_output]) {
+        return pwm_thrust[pwm_output] >> PWM_THRUST_SHIFT;
+    }
+    return ThrustFromDuty(pwm_output,
+            pwm_ticks[pwm_output] * PWM_DUTY_SCALE / pwm_period);
+}
+
+uint32_t GetPwmThrustSlew(uint8_t pwm_output, uint32_t ticks) {
+    return (pwm_slew_step[pwm_output] * ticks) >> PWM_THRUST_SHIFT;
+}
+
+void UpdatePwmShaping(void) {
+    for (uint8_t i = 0; i < 2; i++) {
+        if (!pwm_shaped[i]) {
+            continue;
+        }
+        uint32_t thrust = pwm_thrust[i];
+        uint32_t target = pwm_thrust_target[i];
+        uint32_t step = pwm_slew_step[i];
+        if (target > thrust + step) {
+            thrust += step;
+        } else if (target + step < thrust) {
+            thrust -= step;
+        } else {
+            thrust = target;
         }
-    } else {
-        duty_cycle = 0;
+        pwm_thrust[i] = thrust;
+
+        uint32_t duty = DutyFromThrust(i, thrust >> PWM_THRUST_SHIFT);
+        PwmCompareSet(i, pwm_period * duty / PWM_DUTY_SCALE);
     }
-    return duty_cycle;
+}
+
+void SetPwmDutyCycle(uint8_t pwm_output, uint32_t duty_cycle) {
+    SetPwmDutyPermille(pwm_output, duty_cycle * (PWM_DUTY_SCALE / 100));
+}
+
+uint32_t GetPwmDutyCycle(uint8_t pwm_output) {
+    return GetPwmDutyTicks(pwm_output) * 100 / pwm_period;
 }
 
 /**
@@ -130,16 +393,8 @@ uint32_t GetPwmDutyCycle(uint8_t pwm_output) {
  * @param state The output state, either true (on) or false (off);
  */
 void SetPwmState(uint8_t pwm_output, bool state) {
-    switch (pwm_output) {
-    case MAIN_ROTOR:
-        PWMOutputState(PWM_MAIN_BASE, PWM_MAIN_OUTBIT, state);
-        pwm_state[MAIN_ROTOR] = state;
-        break;
-    case TAIL_ROTOR:
-        PWMOutputState(PWM_TAIL_BASE, PWM_TAIL_OUTBIT, state);
-        pwm_state[TAIL_ROTOR] = state;
-        break;
-    }
+    PWMOutputState(pwm_base[pwm_output], pwm_outbit[pwm_output], state);
+    pwm_state[pwm_output] = state;
 }
 
 void PwmEnable(uint8_t pwm_output) {
@@ -15,10 +15,26 @@
 #define PWM_H_
 
 /*
- * The frequency of the PWM output signal (Hz).
+ * The frequency of the PWM output signal (Hz). This is independent of the
+ * control loop rates defined in flight_controller.h.
  */
 #define PWM_FREQUENCY 200
 
+/*
+ * Duty cycle of a fully on output, in the units of the permille duty cycle
+ * API.
+ */
+#define PWM_DUTY_SCALE 1000
+
+/*
+ * Whether duty cycle changes are staged and only take effect on both rotors
+ * together at the next period boundary after PwmCommit(). Otherwise each
+ * change takes effect as soon as it is written.
+ */
+#ifndef PWM_SYNC_UPDATES
+#define PWM_SYNC_UPDATES 1
+#endif
+
 /**
  * An enumeration for determining which PWM output to configure.
  */
@@ -38,6 +54,82 @@ enum PwmOutput {
  */
 void PwmInit();
 
+/**
+ * Get the period of the PWM outputs, computed once by PwmInit().
+ *
+ * @return The period (PWM clock ticks).
+ */
+uint32_t GetPwmPeriod(void);
+
+/**
+ * Set the pulse width of the PWM output. The cheapest way to drive an output,
+ * at the full resolution of the generator.
+ *
+ * @param pwm_output The PWM output to configure.
+ * @param ticks The pulse width (PWM clock ticks), less than the period.
+ */
+void SetPwmDutyTicks(uint8_t pwm_output, uint32_t ticks);
+
+/**
+ * Get the pulse width of the PWM output.
+ *
+ * @param pwm_output The PWM output.
+ * @return The pulse width (PWM clock ticks), or 0 if the output is disabled.
+ */
+uint32_t GetPwmDutyTicks(uint8_t pwm_output);
+
+/**
+ * Set the duty cycle of the PWM output in the range 20-980 permille.
+ *
+ * @param pwm_output The PWM output to configure.
+ * @param duty_cycle The desired duty cycle, in the range 20-980 permille.
+ */
+void SetPwmDutyPermille(uint8_t pwm_output, uint32_t duty_cycle);
+
+/**
+ * Get the duty cycle of the PWM output. For a shaped output this is the duty
+ * cycle the shaping stage has reached, not the one last commanded.
+ *
+ * @param pwm_output The PWM output.
+ * @return The duty cycle (permille), or 0 if the output is disabled.
+ */
+uint32_t GetPwmDutyPermille(uint8_t pwm_output);
+
+/**
+ * Command the thrust of a rotor through the actuator shaping stage. The
+ * output slews towards the thrust on each UpdatePwmShaping(), which
+ * linearises it to a duty cycle and lifts it over the rotor deadband.
+ *
+ * @param pwm_output The PWM output to configure.
+ * @param thrust The thrust (permille of full thrust).
+ */
+void SetPwmThrust(uint8_t pwm_output, uint32_t thrust);
+
+/**
+ * Get the thrust the shaping stage has reached. For an output written
+ * directly, the thrust its duty cycle gives.
+ *
+ * @param pwm_output The PWM output.
+ * @return The thrust (permille of full thrust).
+ */
+uint32_t GetPwmThrust(uint8_t pwm_output);
+
+/**
+ * Get the largest change in thrust the shaping stage makes over a number of
+ * control ticks.
+ *
+ * @param pwm_output The PWM output.
+ * @param ticks The number of control ticks.
+ * @return The change in thrust (permille of full thrust).
+ */
+uint32_t GetPwmThrustSlew(uint8_t pwm_output, uint32_t ticks);
+
+/**
+ * Move each shaped output one slew limited step towards its commanded thrust.
+ * Must be called at CONTROL_FREQUENCY.
+ */
+void UpdatePwmShaping(void);
+
 /**
  * Set the duty cycle of the PWM output in the range 2-98%.
  *
@@ -54,6 +146,27 @@ void SetPwmDutyCycle(uint8_t pwm_output, uint32_t duty_cycle);
  */
 uint32_t GetPwmDutyCycle(uint8_t pwm_output);
 
+/**
+ * Commit the staged duty cycles of both rotors. They take effect together at
+ * the next period boundary of each generator. Does nothing unless
+ * PWM_SYNC_UPDATES is set.
+ */
+void PwmCommit(void);
+
+/**
+ * Register a function to be called from the PWM interrupt at a period boundary
+ * of the main rotor generator, and arm it for the next boundary.
+ *
+ * @param callback The function to call.
+ */
+void PwmZeroCallbackRegister(void (*callback)(void));
+
+/**
+ * Arm the registered callback to be called once more, at the next period
+ * boundary of the main rotor generator.
+ */
+void PwmZeroCallbackArm(void);
+
 /**
  * Disable the given PWM output.
  *
@@ -49,3 +49,7 @@ void SerialInit() {
 
     UARTStdioConfig(UART_PORT, BAUD_RATE, UART_PIOSC_FREQUENCY);
 }
+
+int32_t SerialCharGet(void) {
+    return UARTCharGetNonBlocking(UART_BASE);
+}
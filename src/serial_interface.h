@@ -17,4 +17,11 @@
  */
 void SerialInit();
 
+/**
+ * Get a character received from the UART without waiting.
+ *
+ * @return The character, or -1 if none has been received.
+ */
+int32_t SerialCharGet(void);
+
 #endif /* SERIAL_INTERFACE_H_ */
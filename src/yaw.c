@@ -7,12 +7,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "inc/hw_gpio.h"
 #include "inc/hw_ints.h"
 #include "inc/hw_memmap.h"
+#include "inc/hw_types.h"
 #include "driverlib/gpio.h"
 #include "driverlib/interrupt.h"
+#include "driverlib/pin_map.h"
+#include "driverlib/qei.h"
 #include "driverlib/sysctl.h"
 
+#include "clock.h"
+#include "flight_controller.h"
+#include "profile.h"
 #include "yaw.h"
 
 /*
@@ -26,6 +33,31 @@
 #define YAW_INT                 INT_GPIOB
 /** @} */
 
+/*
+ * QEI definitions. PD7 is locked as the NMI pin by default.
+ */
+#define QEI_PERIPH              SYSCTL_PERIPH_QEI0
+#define QEI_BASE                QEI0_BASE
+#define QEI_GPIO_PERIPH         SYSCTL_PERIPH_GPIOD
+#define QEI_GPIO_BASE           GPIO_PORTD_BASE
+#define QEI_CHANNEL_A           GPIO_PIN_6
+#define QEI_CHANNEL_B           GPIO_PIN_7
+#define QEI_CHANNEL_A_CONFIG    GPIO_PD6_PHA0
+#define QEI_CHANNEL_B_CONFIG    GPIO_PD7_PHB0
+
+/*
+ * The QEI counts up when channel A leads, the opposite way to the lookup
+ * table, so the channels are swapped to keep the same sense of rotation.
+ */
+#define QEI_CONFIG              (QEI_CONFIG_CAPTURE_A_B | QEI_CONFIG_NO_RESET \
+                                 | QEI_CONFIG_QUADRATURE | QEI_CONFIG_SWAP)
+#define QEI_INT                 INT_QEI0
+
+/*
+ * Input filter of the QEI, in system clocks a level must be held for.
+ */
+#define QEI_FILTER              QEI_FILTCNT_17
+
 /*
  * Reference yaw definitions.
  */
@@ -34,28 +66,142 @@
 #define YAW_REF_PIN             GPIO_PIN_4
 #define YAW_REF_INT             INT_GPIOC
 
-static volatile int32_t yaw = 0;
 static volatile bool ref_found = false;
+static int32_t yaw_rate = 0;
+
+static volatile uint32_t glitches[NUM_YAW_GLITCHES];
+static volatile uint32_t edge_interval_min = UINT32_MAX;
+#if YAW_GLITCH_FILTER_US > 0
+static uint32_t glitch_filter_ticks;
+
+/*
+ * The pins after the last edge held back by the glitch filter, until the next
+ * edge shows whether it was real.
+ */
+static bool filter_held = false;
+static uint8_t filter_held_pins;
+#endif
+
+#if YAW_DECODER == YAW_DECODER_GPIO
+static volatile int32_t yaw = 0;
+static volatile uint64_t yaw_timestamp = 0;
+static uint64_t edge_timestamp = 0;
+
+/*
+ * The yaw and time of the last edge seen by the rate estimate.
+ */
+static int32_t rate_edge_yaw = 0;
+static uint64_t rate_edge_timestamp = 0;
 
 static const int8_t lookup_table[] = { 0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0 };
+#else
+/*
+ * The hardware count at the reference yaw.
+ */
+static volatile uint32_t yaw_offset = 0;
+#endif
+
+#if YAW_DECODER == YAW_DECODER_GPIO
 
 /**
- * Yaw interrupt handler.
+ * Decode the yaw channels after an edge.
  */
-static void YawHandler(void) {
+static inline void YawDecode(void) {
     static uint8_t state = 0;
-    uint8_t previous_state = state;
-    state = (uint8_t) GPIOPinRead(YAW_BASE, YAW_GPIO_PINS);
+    uint64_t now = MonotonicTicks();
+    uint8_t pins = (uint8_t) GPIOPinRead(YAW_BASE, YAW_GPIO_PINS);
 
     GPIOIntClear(YAW_BASE, YAW_GPIO_PINS);
 
-    /**
-     * Increments the yaw depending on the state and the previous state.
-     * Lookup table should never return 0, since this would indicate an invalid state transition.
+    /*
+     * The shortest time between interrupts shows how close the edges come to
+     * the interrupt latency.
+     */
+    uint64_t interval = now - edge_timestamp;
+    edge_timestamp = now;
+    if (interval < edge_interval_min) {
+        edge_interval_min = (uint32_t) interval;
+    }
+
+    uint8_t change = pins ^ state;
+#if YAW_GLITCH_FILTER_US > 0
+    bool held = filter_held;
+    filter_held = false;
+#endif
+    if (change == 0) {
+#if YAW_GLITCH_FILTER_US > 0
+        /*
+         * A held edge which has reverted was a glitch, and is already counted
+         * as filtered.
+         */
+        if (held) {
+            return;
+        }
+#endif
+        glitches[YAW_GLITCH_SPURIOUS]++;
+        return;
+    }
+
+#if YAW_GLITCH_FILTER_US > 0
+    /*
+     * Hold the edge back, leaving the state alone, until the next edge shows
+     * whether it was real.
+     */
+    if (now - yaw_timestamp < glitch_filter_ticks) {
+        glitches[YAW_GLITCH_FILTERED]++;
+        filter_held = true;
+        filter_held_pins = pins;
+        return;
+    }
+
+    /*
+     * A held edge followed by an edge on the other channel was real, so step
+     * through it before decoding the new edge.
      */
-    yaw += lookup_table[state | (previous_state << 2)];
+    uint8_t held_change = filter_held_pins ^ state;
+    if (held && change == YAW_GPIO_PINS && held_change != 0
+            && held_change != YAW_GPIO_PINS) {
+        yaw += lookup_table[filter_held_pins | (state << 2)];
+        state = filter_held_pins;
+        change = pins ^ state;
+    }
+#endif
+
+    if (change == YAW_GPIO_PINS) {
+        /*
+         * The direction of a missed edge is unknown, so it is not counted.
+         */
+        glitches[YAW_GLITCH_SKIPPED]++;
+    } else {
+        /*
+         * Increments the yaw depending on the state and the previous state.
+         */
+        yaw += lookup_table[pins | (state << 2)];
+        yaw_timestamp = now;
+    }
+    state = pins;
 }
 
+/**
+ * Yaw interrupt handler.
+ */
+static void YawHandler(void) {
+    uint32_t start = ProfileStart();
+    YawDecode();
+    ProfileEnd(PROFILE_YAW_HANDLER, start);
+}
+#else
+/**
+ * QEI interrupt handler. Only enabled for phase errors.
+ */
+static void QeiHandler(void) {
+    uint32_t start = ProfileStart();
+    QEIIntClear(QEI_BASE, QEI_INTERROR);
+    glitches[YAW_GLITCH_SKIPPED]++;
+    ProfileEnd(PROFILE_YAW_HANDLER, start);
+}
+#endif
+
 /**
  * Yaw reference interrupt handler.
  */
@@ -66,12 +212,31 @@ static void YawRefHandler(void) {
     if (GPIOIntStatus(YAW_REF_BASE, false) && YAW_REF_PIN) {
         GPIOIntDisable(YAW_REF_BASE, YAW_REF_PIN);
         GPIOIntClear(YAW_REF_BASE, YAW_REF_PIN);
+#if YAW_DECODER == YAW_DECODER_GPIO
+        /*
+         * Shift the rate reference with the yaw so the reset is not seen as a
+         * step in the rate.
+         */
+        rate_edge_yaw -= yaw;
         yaw = 0;
+        yaw_timestamp = MonotonicTicks();
+#else
+        /*
+         * The count keeps running through the reference, so the reference is
+         * applied as an offset.
+         */
+        yaw_offset = QEIPositionGet(QEI_BASE);
+#endif
         ref_found = true;
     }
 }
 
 void YawDetectionInit(void) {
+#if YAW_DECODER == YAW_DECODER_GPIO
+#if YAW_GLITCH_FILTER_US > 0
+    glitch_filter_ticks = MicrosToTicks(YAW_GLITCH_FILTER_US);
+#endif
+
     /*
      * Initialise the yaw GPIO pins.
      */
@@ -89,6 +254,44 @@ void YawDetectionInit(void) {
     GPIOIntClear(YAW_BASE, YAW_GPIO_PINS);
     GPIOIntEnable(YAW_BASE, YAW_GPIO_PINS);
     IntEnable(YAW_INT);
+#else
+    /*
+     * Unlock PD7 and hand both channels to the QEI.
+     */
+    SysCtlPeripheralEnable(QEI_GPIO_PERIPH);
+    SysCtlPeripheralEnable(QEI_PERIPH);
+    HWREG(QEI_GPIO_BASE + GPIO_O_LOCK) = GPIO_LOCK_KEY;
+    HWREG(QEI_GPIO_BASE + GPIO_O_CR) |= QEI_CHANNEL_B;
+    HWREG(QEI_GPIO_BASE + GPIO_O_LOCK) = 0;
+    GPIOPinConfigure(QEI_CHANNEL_A_CONFIG);
+    GPIOPinConfigure(QEI_CHANNEL_B_CONFIG);
+    GPIOPinTypeQEI(QEI_GPIO_BASE, QEI_CHANNEL_A | QEI_CHANNEL_B);
+
+    /*
+     * Count every edge of both channels over the full 32-bit range, so the
+     * count wraps the same way as the signed yaw. The velocity capture counts
+     * the edges over one rate window.
+     */
+    QEIDisable(QEI_BASE);
+    QEIConfigure(QEI_BASE, QEI_CONFIG, UINT32_MAX);
+    QEIPositionSet(QEI_BASE, 0);
+    QEIVelocityConfigure(QEI_BASE, QEI_VELDIV_1,
+            SysCtlClockGet() / CONTROL_FREQUENCY * YAW_RATE_WINDOW);
+    QEIVelocityEnable(QEI_BASE);
+#if YAW_GLITCH_FILTER_US > 0
+    QEIFilterConfigure(QEI_BASE, QEI_FILTER);
+    QEIFilterEnable(QEI_BASE);
+#endif
+    QEIEnable(QEI_BASE);
+
+    /*
+     * Count the phase errors, where both channels change at once.
+     */
+    QEIIntRegister(QEI_BASE, QeiHandler);
+    QEIIntClear(QEI_BASE, QEI_INTERROR);
+    QEIIntEnable(QEI_BASE, QEI_INTERROR);
+    IntEnable(QEI_INT);
+#endif
 
     /*
      * Initialise the reference yaw GPIO pins.
@@ -118,10 +321,111 @@ bool YawRefFound(void) {
     return ref_found;
 }
 
+#if YAW_DECODER == YAW_DECODER_GPIO
 int32_t GetYaw(void) {
     return yaw;
 }
 
+TimedSample GetYawSample(void) {
+    TimedSample sample;
+
+    /*
+     * Retry if an edge updated the yaw while it was being read.
+     */
+    do {
+        sample.timestamp = yaw_timestamp;
+        sample.value = yaw;
+    } while (sample.timestamp != yaw_timestamp);
+
+    return sample;
+}
+
+uint32_t GetYawSampleAge(void) {
+    return MicrosSince(yaw_timestamp);
+}
+
+void UpdateYawRate(void) {
+    TimedSample edge = GetYawSample();
+
+    if (edge.timestamp != rate_edge_timestamp) {
+        /*
+         * Edges counted (M) over the time between the last edges (T).
+         */
+        uint64_t delta_t = edge.timestamp - rate_edge_timestamp;
+        int32_t yaw_delta = edge.value - rate_edge_yaw;
+        if (rate_edge_timestamp != 0 && delta_t > 0) {
+            /*
+             * Single precision keeps the division in hardware, and the edges
+             * are far more than a tick apart.
+             */
+            uint32_t delta_ticks = (delta_t > UINT32_MAX) ? UINT32_MAX :
+                    (uint32_t) delta_t;
+            yaw_rate = (int32_t) ((float) yaw_delta
+                    * (float) GetClockFrequency() / (float) delta_ticks);
+        }
+        rate_edge_yaw = edge.value;
+        rate_edge_timestamp = edge.timestamp;
+    } else if (rate_edge_timestamp != 0) {
+        /*
+         * Without a new edge the rate can be no more than one edge over the
+         * time since the last one.
+         */
+        uint32_t since = TicksSince(rate_edge_timestamp);
+        int32_t rate_max = (since > 0) ?
+                (int32_t) (GetClockFrequency() / since) : INT32_MAX;
+        if (yaw_rate > rate_max) {
+            yaw_rate = rate_max;
+        } else if (yaw_rate < -rate_max) {
+            yaw_rate = -rate_max;
+        }
+    }
+}
+#else
+int32_t GetYaw(void) {
+    return (int32_t) (QEIPositionGet(QEI_BASE) - yaw_offset);
+}
+
+TimedSample GetYawSample(void) {
+    TimedSample sample;
+    sample.value = GetYaw();
+    sample.timestamp = MonotonicTicks();
+    return sample;
+}
+
+uint32_t GetYawSampleAge(void) {
+    return 0;
+}
+
+void UpdateYawRate(void) {
+    /*
+     * The velocity capture holds the edges counted over the last full window.
+     */
+    int32_t yaw_delta = (int32_t) QEIVelocityGet(QEI_BASE)
+            * QEIDirectionGet(QEI_BASE);
+    yaw_rate = yaw_delta * CONTROL_FREQUENCY / YAW_RATE_WINDOW;
+}
+#endif
+
+int32_t GetYawRate(void) {
+    return yaw_rate;
+}
+
+uint32_t GetYawGlitchCount(uint8_t type) {
+    return glitches[type];
+}
+
+uint32_t GetYawEdgeIntervalMin(void) {
+    uint32_t interval = edge_interval_min;
+    return (interval == UINT32_MAX) ? UINT32_MAX : TicksToMicros(interval);
+}
+
+void ResetYawGlitchStats(void) {
+    for (uint8_t i = 0; i < NUM_YAW_GLITCHES; i++) {
+        glitches[i] = 0;
+    }
+    edge_interval_min = UINT32_MAX;
+}
+
 int32_t GetClosestYawRef(int32_t current_yaw) {
     /*
      * Gets the yaw remainder, in the range [0, YAW_FULL_ROTATION).
@@ -135,6 +439,6 @@ int32_t GetClosestYawRef(int32_t current_yaw) {
 }
 
 int32_t GetYawDegrees(void) {
-    int32_t degrees = yaw * 360 / YAW_FULL_ROTATION;
+    int32_t degrees = GetYaw() * 360 / YAW_FULL_ROTATION;
     return degrees;
 }
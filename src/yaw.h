@@ -12,6 +12,23 @@
 #ifndef YAW_H_
 #define YAW_H_
 
+#include "clock.h"
+
+/*
+ * Yaw decoders. The GPIO decoder takes an interrupt on every edge of both
+ * channels on PB0 and PB1. The QEI decoder counts the edges in hardware on
+ * QEI0, and needs the channels wired to PD6 and PD7 instead.
+ */
+#define YAW_DECODER_GPIO        0
+#define YAW_DECODER_QEI         1
+
+/*
+ * The yaw decoder, one of YAW_DECODER_GPIO or YAW_DECODER_QEI.
+ */
+#ifndef YAW_DECODER
+#define YAW_DECODER             YAW_DECODER_GPIO
+#endif
+
 /*
  * The number of slots in 360 degrees of rotation.
  */
@@ -22,6 +39,49 @@
  */
 #define YAW_FULL_ROTATION       (NUMBER_SLOTS * 4)
 
+/*
+ * Number of yaw rate updates the QEI velocity capture is taken over. A longer
+ * window gives a finer rate resolution at the cost of more lag.
+ */
+#define YAW_RATE_WINDOW         32
+
+/*
+ * Edges closer than this to the previous accepted edge are held back as
+ * possible glitches (us), or 0 to accept every edge. A held edge followed by
+ * an edge on the other channel was real, and both are counted then. One which
+ * reverts is dropped. If another edge is held back before the next accepted
+ * one, only the latest is kept, and a real edge lost this way is counted as a
+ * skipped glitch. The QEI decoder uses its input filter instead.
+ */
+#ifndef YAW_GLITCH_FILTER_US
+#define YAW_GLITCH_FILTER_US    0
+#endif
+
+/**
+ * Types of invalid yaw transitions.
+ */
+enum YawGlitch {
+    /**
+     * An interrupt with neither channel changed, from a pulse shorter than the
+     * interrupt latency.
+     */
+    YAW_GLITCH_SPURIOUS,
+    /**
+     * Both channels changed at once, so an edge was missed and the yaw lost a
+     * count. The QEI decoder reports its phase errors here.
+     */
+    YAW_GLITCH_SKIPPED,
+    /**
+     * An edge held back by the glitch filter, whether or not the next edge
+     * shows it was real.
+     */
+    YAW_GLITCH_FILTERED,
+    /**
+     * The total number of glitch types.
+     */
+    NUM_YAW_GLITCHES
+};
+
 /**
  * Initialises the yaw manager.
  */
@@ -41,6 +101,60 @@ int32_t GetYaw(void);
  */
 int32_t GetYawDegrees(void);
 
+/**
+ * Get the current yaw and the time of the edge which last changed it.
+ *
+ * @return The yaw (notches) and its timestamp.
+ */
+TimedSample GetYawSample(void);
+
+/**
+ * Get the time since the yaw last changed. Always 0 with the QEI decoder,
+ * which is read directly from the hardware count.
+ *
+ * @return The sample age (us).
+ */
+uint32_t GetYawSampleAge(void);
+
+/**
+ * Get the number of invalid transitions of a type since the last reset.
+ *
+ * @param type The glitch type.
+ * @return The number of glitches.
+ * @see YawGlitch
+ */
+uint32_t GetYawGlitchCount(uint8_t type);
+
+/**
+ * Get the shortest time between two yaw interrupts since the last reset. Not
+ * measured by the QEI decoder.
+ *
+ * @return The interval (us), or UINT32_MAX if none has been measured.
+ */
+uint32_t GetYawEdgeIntervalMin(void);
+
+/**
+ * Clear the glitch counters and the shortest edge interval.
+ */
+void ResetYawGlitchStats(void);
+
+/**
+ * Update the yaw rate estimate. Must be called at CONTROL_FREQUENCY.
+ */
+void UpdateYawRate(void);
+
+/**
+ * Get the yaw rate. The GPIO decoder divides the edges counted between the
+ * last edges seen by two updates by the time between those edges (the M/T
+ * method), which stays accurate from a single slow edge to many fast ones.
+ * While no edges arrive the rate decays as the inverse of the time since the
+ * last edge. The QEI decoder counts the edges over the last YAW_RATE_WINDOW
+ * updates.
+ *
+ * @return the yaw rate (notches per second)
+ */
+int32_t GetYawRate(void);
+
 /**
  * Helper function to return the closest yaw such that the helicopter is facing towards the camera.
  *
@@ -0,0 +1,157 @@
+/**
+ * Program to log the main to tail rotor coupling for python/coupling.py.
+ *
+ * Flip the switch up to start a session, then step the height target with the
+ * up and down buttons while the yaw is held. Flip the switch down to end it.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "driverlib/fpu.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "driverlib/systick.h"
+#include "utils/scheduler.h"
+#include "utils/uartstdio.h"
+
+#include "axis_controller.h"
+#include "buttons.h"
+#include "clock.h"
+#include "flight_controller.h"
+#include "height.h"
+#include "pwm.h"
+#include "reset.h"
+#include "serial_interface.h"
+#include "switch.h"
+#include "yaw.h"
+
+/*
+ * Height change per button press (%).
+ */
+#define HEIGHT_STEP             10
+
+#ifdef DEBUG
+void __error__(char *pcFilename, uint32_t ui32Line) {
+    while (1) {
+    }
+}
+#endif
+
+/*
+ * Register task function prototypes.
+ */
+void UpdateSerial();
+void Stepping();
+
+/*
+ * Register function prototypes.
+ */
+void Initialise(void);
+void Start(void);
+
+/*
+ * Serial logging runs at 50 Hz, fast enough to see the spin up of the main
+ * rotor at 9600 baud.
+ */
+tSchedulerTask g_psSchedulerTable[] = {
+        [0] = { .bActive = true, .pfnFunction = UpdateButtons, .ui32FrequencyTicks = 2 },
+        [1] = { .bActive = true, .pfnFunction = UpdateSwitch, .ui32FrequencyTicks = 2 },
+        [2] = { .bActive = true, .pfnFunction = UpdateSerial, .ui32FrequencyTicks = SCHEDULER_FREQUENCY / 50 },
+        [3] = { .bActive = true, .pfnFunction = Stepping, .ui32FrequencyTicks = 10 } };
+uint32_t g_ui32SchedulerNumTasks = 4;
+
+void Initialise(void) {
+    /*
+     * Set the clock to 80 MHz.
+     */
+    SysCtlClockSet(
+    SYSCTL_SYSDIV_2_5 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN | SYSCTL_XTAL_16MHZ);
+
+    /*
+     * Enable lazy stacking for interrupt handlers. This allows floating-point
+     * instructions to be used within interrupt handlers, but at the expense of
+     * extra stack usage.
+     */
+    FPULazyStackingEnable();
+
+    SchedulerInit(SCHEDULER_FREQUENCY);
+    SysTickIntRegister(SchedulerSysTickIntHandler);
+
+    ClockInit();
+    ResetInit();
+    ButtonsInit();
+    SwitchInit();
+
+    YawDetectionInit();
+    HeightManagerInit();
+
+    PwmInit();
+    AxisControllerInit();
+
+    PriorityTaskInit();
+
+    SerialInit();
+    SchedulerTaskDisable(2);
+
+    SetAxisTarget(AXIS_YAW, 0);
+    SetAxisTarget(AXIS_HEIGHT, 0);
+}
+
+/**
+ * Calibrate the zero height with the rotors stopped, then start the
+ * controllers from a clean state. Interrupts must be enabled.
+ */
+void Start(void) {
+    ZeroHeightTrigger();
+    while (!HeightRefFound()) {
+    }
+
+    AxisControllerInit();
+    PriorityTaskEnable();
+    PwmEnable(MAIN_ROTOR);
+    PwmEnable(TAIL_ROTOR);
+}
+
+void Stepping() {
+    static bool started = false;
+    int32_t height = GetAxisTarget(AXIS_HEIGHT);
+
+    if (GetSwitchEvent() == SWITCH_UP && !started) {
+        started = true;
+        UARTprintf("start\n");
+        SchedulerTaskEnable(2, true);
+    } else if (GetSwitchEvent() == SWITCH_DOWN && started) {
+        started = false;
+        SetAxisTarget(AXIS_HEIGHT, 0);
+        UARTprintf("end\n");
+        SchedulerTaskDisable(2);
+    }
+
+    if (!started) {
+        return;
+    }
+
+    height += HEIGHT_STEP * NumPushes(BTN_UP);
+    height -= HEIGHT_STEP * NumPushes(BTN_DOWN);
+    height = (height < 0) ? 0 : (height > 100) ? 100 : height;
+    SetAxisTarget(AXIS_HEIGHT, height);
+}
+
+/**
+ * Send the main and tail duty cycles and the yaw rate to UART.
+ */
+void UpdateSerial() {
+    UARTprintf("%d, %d, %d\n", GetPwmDutyPermille(MAIN_ROTOR),
+            GetPwmDutyPermille(TAIL_ROTOR), GetYawRate());
+}
+
+int main(void) {
+    Initialise();
+    IntMasterEnable();
+    Start();
+
+    while (1) {
+        SchedulerRun();
+    }
+}
@@ -0,0 +1,357 @@
+/**
+ * Program to compare the pid kernel against a double-precision reference of
+ * the same control law, counting the updates whose output differs and
+ * comparing their cycle counts, and to check the gain schedule interpolation.
+ *
+ * The reference run saturates the output, narrows the output to a slew limited
+ * reach for its second half and changes gains with a bumpless transfer, so the
+ * anti-windup, the filtered derivative on measurement and the transfer are all
+ * checked.
+ *
+ * Build with PID_KERNEL set to PID_KERNEL_FLOAT or PID_KERNEL_FIXED and read
+ * the results from the UART.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "inc/hw_types.h"
+#include "driverlib/fpu.h"
+#include "driverlib/interrupt.h"
+#include "driverlib/sysctl.h"
+#include "utils/uartstdio.h"
+
+#include "pid.h"
+#include "serial_interface.h"
+
+/*
+ * Data watchpoint and trace unit registers.
+ */
+#define DEMCR                   0xE000EDFC
+#define DEMCR_TRCENA            0x01000000
+#define DWT_CTRL                0xE0001000
+#define DWT_CTRL_CYCCNTENA      0x00000001
+#define DWT_CYCCNT              0xE0001004
+
+/*
+ * Number of pid updates to time for each implementation.
+ */
+#define NUM_ITERATIONS          1000
+
+/*
+ * Update period passed to the pid controllers (us).
+ */
+#define DELTA_T                 5000
+
+/*
+ * Output range, narrow enough that the test sequence saturates it, and the
+ * constant feedforward.
+ */
+#define OUTPUT_MIN              -20
+#define OUTPUT_MAX              20
+#define FEEDFORWARD             5
+
+/*
+ * Largest change in output per update while the reach is slew limited.
+ */
+#define OUTPUT_SLEW             3
+
+/*
+ * Range of the schedule variable in the gain schedule check, swept with a
+ * margin either side to check the clamping.
+ */
+#define SCHEDULE_RANGE          100
+#define SCHEDULE_MARGIN         10
+
+/*
+ * Number of entries in the gain schedule check table.
+ */
+#define SCHEDULE_SIZE           4
+
+#ifdef DEBUG
+void __error__(char *pcFilename, uint32_t ui32Line) {
+    while (1) {
+    }
+}
+#endif
+
+/**
+ * Double-precision pid gains, per microsecond.
+ */
+typedef struct {
+    double proportional;
+    double integral;
+    double derivative;
+} DoublePidGains;
+
+/**
+ * The double-precision pid state.
+ */
+typedef struct {
+    int32_t error_previous;
+    int32_t measurement_previous;
+    double derivative;
+    double integral;
+    bool primed;
+} DoublePidState;
+
+double Clamp(double value, double min, double max) {
+    return (value > max) ? max : (value < min) ? min : value;
+}
+
+/**
+ * The double-precision reference of UpdatePid().
+ */
+int32_t UpdateDoublePid(DoublePidState *state, int32_t target,
+        int32_t measurement, int32_t feedforward, uint32_t delta_t,
+        const DoublePidGains *gains, const PidLimits *limits,
+        const PidLimits *reach) {
+    int32_t error = target - measurement;
+
+    if (!state->primed) {
+        state->measurement_previous = measurement;
+        state->primed = true;
+    }
+
+    double rate = (double) (measurement - state->measurement_previous)
+            / delta_t;
+    state->derivative += (rate - state->derivative)
+            / (1 << PID_DERIVATIVE_FILTER_SHIFT);
+
+    state->error_previous = error;
+    state->measurement_previous = measurement;
+
+    double control = feedforward + gains->proportional * error
+            - gains->derivative * state->derivative;
+    double unsaturated = control + state->integral;
+
+    if (!((unsaturated >= reach->output_max && error > 0)
+            || (unsaturated <= reach->output_min && error < 0))) {
+        state->integral = Clamp(
+                state->integral + gains->integral * error * (double) delta_t,
+                limits->output_min - feedforward,
+                limits->output_max - feedforward);
+    }
+
+    return (int32_t) Clamp(control + state->integral, reach->output_min,
+            reach->output_max);
+}
+
+/**
+ * The double-precision reference of PidBumplessTransfer().
+ */
+void DoublePidBumplessTransfer(DoublePidState *state,
+        const DoublePidGains *from, const DoublePidGains *to) {
+    state->integral += (from->proportional - to->proportional)
+            * state->error_previous
+            - (from->derivative - to->derivative) * state->derivative;
+}
+
+/**
+ * A cycle count summary.
+ */
+typedef struct {
+    uint32_t min;
+    uint32_t max;
+    uint32_t total;
+} CycleStats;
+
+void Initialise(void) {
+    SysCtlClockSet(
+    SYSCTL_SYSDIV_2_5 | SYSCTL_USE_PLL | SYSCTL_OSC_MAIN | SYSCTL_XTAL_16MHZ);
+
+    /*
+     * Match the main program so the timings include lazy stacking.
+     */
+    FPULazyStackingEnable();
+
+    HWREG(DEMCR) |= DEMCR_TRCENA;
+    HWREG(DWT_CYCCNT) = 0;
+    HWREG(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+
+    SerialInit();
+}
+
+/**
+ * A repeatable error sequence resembling a step response.
+ */
+int32_t TestError(uint32_t i) {
+    return (int32_t) (500 - (i % 100) * 10) + (int32_t) (i * 7919 % 13) - 6;
+}
+
+/**
+ * Gains for the schedule check, spaced evenly over SCHEDULE_RANGE. The steps
+ * between entries differ in size and sign so a wrong bracket is seen.
+ */
+const double schedule_table[SCHEDULE_SIZE][3] = {
+    { 0.050, 2.7e-8, 6700.0 },
+    { 0.080, 1.0e-8, 9000.0 },
+    { 0.020, 4.0e-8, 1000.0 },
+    { 0.060, 4.0e-8, 3000.0 } };
+
+/**
+ * Convert a gain in the kernel representation to a double.
+ */
+double GainValue(PidGain gain, double scale) {
+#if PID_KERNEL == PID_KERNEL_FIXED
+    return (double) gain / scale;
+#else
+    return (double) gain;
+#endif
+}
+
+/**
+ * Check one interpolated gain against the double-precision reference. The
+ * kernel weight has PID_WEIGHT_SHIFT bits, so the result may be off by that
+ * fraction of the step between entries plus the resolution of the gain.
+ */
+bool GainMatches(PidGain gain, double scale, double lower, double upper,
+        double fraction) {
+    double reference = lower + (upper - lower) * fraction;
+    double tolerance = fabs(upper - lower) / PID_WEIGHT_ONE
+#if PID_KERNEL == PID_KERNEL_FIXED
+            + 2.0 / scale;
+#else
+            + 1e-6 * fabs(reference);
+#endif
+    return fabs(GainValue(gain, scale) - reference) <= tolerance;
+}
+
+/**
+ * Sweep the schedule variable over the gain table and count the gains which
+ * do not match the reference interpolation.
+ */
+uint32_t CheckSchedule(void) {
+    PidGains table[SCHEDULE_SIZE];
+    for (uint32_t i = 0; i < SCHEDULE_SIZE; i++) {
+        PidGainsSet(&table[i], schedule_table[i][0], schedule_table[i][1],
+                schedule_table[i][2]);
+    }
+
+    uint32_t mismatches = 0;
+    for (int32_t position = -SCHEDULE_MARGIN;
+            position <= SCHEDULE_RANGE + SCHEDULE_MARGIN; position++) {
+        PidGains gains;
+        PidGainsSchedule(&gains, table, SCHEDULE_SIZE, position,
+                SCHEDULE_RANGE);
+
+        int32_t clamped = (position < 0) ? 0 :
+                (position > SCHEDULE_RANGE) ? SCHEDULE_RANGE : position;
+        double scaled = (double) clamped * (SCHEDULE_SIZE - 1)
+                / SCHEDULE_RANGE;
+        uint32_t index = (uint32_t) scaled;
+        index = (index > SCHEDULE_SIZE - 2) ? SCHEDULE_SIZE - 2 : index;
+        double fraction = scaled - index;
+        const double *lower = schedule_table[index];
+        const double *upper = schedule_table[index + 1];
+
+#if PID_KERNEL == PID_KERNEL_FIXED
+        const double scales[3] = { 1L << PID_FIXED_SHIFT,
+                1LL << PID_FIXED_INTEGRAL_SHIFT,
+                1L << PID_FIXED_DERIVATIVE_SHIFT };
+#else
+        const double scales[3] = { 1.0, 1.0, 1.0 };
+#endif
+        if (!GainMatches(gains.proportional, scales[0], lower[0], upper[0],
+                fraction)
+                || !GainMatches(gains.integral, scales[1], lower[1], upper[1],
+                        fraction)
+                || !GainMatches(gains.derivative, scales[2], lower[2],
+                        upper[2], fraction)) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+void CycleStatsAdd(CycleStats *stats, uint32_t cycles) {
+    stats->min = (cycles < stats->min) ? cycles : stats->min;
+    stats->max = (cycles > stats->max) ? cycles : stats->max;
+    stats->total += cycles;
+}
+
+void CycleStatsPrint(const char *name, const CycleStats *stats) {
+    UARTprintf("%s: min %d max %d mean %d cycles\n", name, stats->min,
+            stats->max, stats->total / NUM_ITERATIONS);
+}
+
+int main(void) {
+    Initialise();
+    IntMasterEnable();
+
+    /*
+     * Gains from the height controller, and a second set to transfer to and
+     * back from during the run.
+     */
+    const DoublePidGains double_gains[2] = {
+        { 0.110 / 2.2, 0.110 / 2.2 / (850000.0 * 2.2), 0.110 / 2.2 * 850000.0
+                / 6.3 },
+        { 0.080, 0.080 / 1000000.0, 0.080 * 400000.0 / 6.3 } };
+    PidGains gains[2];
+    for (uint32_t set = 0; set < 2; set++) {
+        PidGainsSet(&gains[set], double_gains[set].proportional,
+                double_gains[set].integral, double_gains[set].derivative);
+    }
+
+    CycleStats double_stats = { UINT32_MAX, 0, 0 };
+    CycleStats kernel_stats = { UINT32_MAX, 0, 0 };
+    uint32_t mismatches = 0;
+
+    DoublePidState double_state = { 0, 0, 0.0, 0.0, false };
+    PidState kernel_state;
+    PidInit(&kernel_state);
+    const PidLimits limits = { OUTPUT_MIN, OUTPUT_MAX };
+    uint32_t set = 0;
+    int32_t control = 0;
+
+    for (uint32_t i = 0; i < NUM_ITERATIONS; i++) {
+        int32_t measurement = -TestError(i);
+
+        if (i == NUM_ITERATIONS / 4 || i == NUM_ITERATIONS * 3 / 4) {
+            DoublePidBumplessTransfer(&double_state, &double_gains[set],
+                    &double_gains[!set]);
+            PidBumplessTransfer(&kernel_state, &gains[set], &gains[!set]);
+            set = !set;
+        }
+
+        /*
+         * Slew limit the reach around the last output for the second half.
+         */
+        PidLimits reach = limits;
+        if (i >= NUM_ITERATIONS / 2) {
+            reach.output_min = Clamp(control - OUTPUT_SLEW, OUTPUT_MIN,
+                    OUTPUT_MAX);
+            reach.output_max = Clamp(control + OUTPUT_SLEW, OUTPUT_MIN,
+                    OUTPUT_MAX);
+        }
+
+        uint32_t start = HWREG(DWT_CYCCNT);
+        int32_t reference = UpdateDoublePid(&double_state, 0, measurement,
+                FEEDFORWARD, DELTA_T, &double_gains[set], &limits, &reach);
+        CycleStatsAdd(&double_stats, HWREG(DWT_CYCCNT) - start);
+
+        start = HWREG(DWT_CYCCNT);
+        control = UpdatePid(&kernel_state, 0, measurement, FEEDFORWARD,
+                DELTA_T, &gains[set], &limits, &reach);
+        CycleStatsAdd(&kernel_stats, HWREG(DWT_CYCCNT) - start);
+
+        if (abs(control - reference) > 1) {
+            mismatches++;
+        }
+    }
+
+    CycleStatsPrint("double", &double_stats);
+#if PID_KERNEL == PID_KERNEL_FIXED
+    CycleStatsPrint("q16.16", &kernel_stats);
+#else
+    CycleStatsPrint("float", &kernel_stats);
+#endif
+
+    UARTprintf("mismatches: %d\n", mismatches);
+    UARTprintf("schedule: %d mismatches\n", CheckSchedule());
+
+    while (1) {
+    }
+}
@@ -1,5 +1,10 @@
 /**
- * Program to find optimal control gains.
+ * Program to find optimal control gains with the relay auto-tuner.
+ *
+ * Choose the axis with the left and right buttons, then flip the switch up to
+ * start the auto-tune once the heli is holding its targets. The measured
+ * ultimate gain and period are written to UART and the tuned gains are used
+ * for the rest of the flight.
  */
 
 #include <stdint.h>
@@ -13,23 +18,39 @@
 #include "utils/uartstdio.h"
 #include "utils/ustdlib.h"
 
+#include "autotune.h"
+#include "axis_controller.h"
 #include "buttons.h"
+#include "clock.h"
 #include "flight_controller.h"
 #include "height.h"
-#include "height_controller.h"
 #include "oled_interface.h"
 #include "pwm.h"
 #include "reset.h"
 #include "serial_interface.h"
 #include "switch.h"
 #include "yaw.h"
-#include "yaw_controller.h"
 
 /*
  * Tuning mode
  */
-static uint8_t mode = TAIL_ROTOR;
-static bool target_reached = false;
+static uint8_t mode = AXIS_YAW;
+
+/*
+ * Relay amplitude of each axis, in control units.
+ */
+static const int32_t relay_amplitude[NUM_AXES] = {
+    [AXIS_HEIGHT] = 100,
+    [AXIS_YAW] = 100,
+    [AXIS_YAW_RATE] = 100 };
+
+/*
+ * Relay hysteresis of each axis, in sensor units.
+ */
+static const int32_t relay_hysteresis[NUM_AXES] = {
+    [AXIS_HEIGHT] = 5,
+    [AXIS_YAW] = 1,
+    [AXIS_YAW_RATE] = 20 };
 
 #ifdef DEBUG
 void __error__(char *pcFilename, uint32_t ui32Line) {
@@ -48,6 +69,7 @@ void Tuning();
  * Register function prototypes.
  */
 void Initialise(void);
+void Start(void);
 
 tSchedulerTask g_psSchedulerTable[] = {
         [0] = { .bActive = true, .pfnFunction = UpdateButtons, .ui32FrequencyTicks = 2 },
@@ -70,9 +92,10 @@ void Initialise(void) {
      */
     FPULazyStackingEnable();
 
-    SchedulerInit(PWM_FREQUENCY);
+    SchedulerInit(SCHEDULER_FREQUENCY);
     SysTickIntRegister(SchedulerSysTickIntHandler);
 
+    ClockInit();
     ResetInit();
     ButtonsInit();
     SwitchInit();
@@ -81,86 +104,73 @@ void Initialise(void) {
     HeightManagerInit();
 
     PwmInit();
-    HeightControllerInit();
-    YawControllerInit();
+    AxisControllerInit();
 
     PriorityTaskInit();
-    PriorityTaskEnable();
 
     SerialInit();
     SchedulerTaskDisable(2);
 
-    if (mode == MAIN_ROTOR) {
-        TuneProportionalMainRotor(0.0);
-    } else {
-        TuneProportionalTailRotor(2.4);
-    }
-    SetTargetYawDegrees(0);
-    SetTargetHeight(50);
+    SetAxisTarget(AXIS_YAW, 0);
+    SetAxisTarget(AXIS_HEIGHT, 50);
+}
+
+/**
+ * Calibrate the zero height with the rotors stopped, then start the
+ * controllers from a clean state. Interrupts must be enabled.
+ */
+void Start(void) {
     ZeroHeightTrigger();
+    while (!HeightRefFound()) {
+    }
 
+    AxisControllerInit();
+    PriorityTaskEnable();
     PwmEnable(MAIN_ROTOR);
     PwmEnable(TAIL_ROTOR);
 }
 
 void Tuning() {
-    static double inc = 0.1;
-    static double gain = 2.4;
-	uint8_t presses[NUM_BUTTONS];
-	static bool started = false;
-
-
-    for (uint8_t i = 0; i < NUM_BUTTONS; i++) {
-        presses[i] = NumPushes(i);
+    static bool started = false;
+
+    if (!started) {
+        /*
+         * Choose the axis to tune.
+         */
+        if (NumPushes(BTN_LEFT) > 0) {
+            mode = (mode + NUM_AXES - 1) % NUM_AXES;
+            UARTprintf("axis [%d]\n", mode);
+        }
+        if (NumPushes(BTN_RIGHT) > 0) {
+            mode = (mode + 1) % NUM_AXES;
+            UARTprintf("axis [%d]\n", mode);
+        }
     }
-	if (!started) {
-
-		if (presses[BTN_UP] > 0) {
-			gain += inc * presses[BTN_UP];
-            UARTprintf("gain [%d]\n", (uint32_t) (gain * 1000));
-		}
-		if (presses[BTN_DOWN] > 0) {
-			gain -= inc * presses[BTN_DOWN];
-            UARTprintf("gain [%d]\n", (uint32_t) (gain * 1000));
-		}
-
-		if (presses[BTN_LEFT] > 0) {
-			inc /= 0.1;
-		}
-
-		if (presses[BTN_RIGHT] > 0) {
-			inc *= 0.1;
-		}
-
-		/*
-		 * Don't let the gain fail below zero
-		 */
-		gain = gain < 0 ? 0 : gain;
-	}
 
     if (GetSwitchEvent() == SWITCH_UP) {
-    	if (!started) {
-    		started = true;
-            if (mode == MAIN_ROTOR) {
-                target_reached = false;
-                TuneProportionalMainRotor(0.0);
-                SysCtlDelay(SysCtlClockGet() / 6);
-                TuneProportionalMainRotor(gain);
-            } else {
-                TuneProportionalTailRotor(0.0);
-                SysCtlDelay(SysCtlClockGet() / 9);
-                TuneProportionalTailRotor(gain);
-            }
-    		UARTprintf("start\n");
-    		SchedulerTaskEnable(2, true);
-    	}
-        TuneProportionalTailRotor(gain);
-    } else {
-    	if (started) {
-    		started = false;
-            UARTprintf("end [%d]\n", (uint32_t) (gain * 1000));
-            SchedulerTaskDisable(2);
-    	}
+        if (!started) {
+            started = true;
+            AutotuneStart(mode, relay_amplitude[mode], relay_hysteresis[mode]);
+            UARTprintf("start\n");
+            SchedulerTaskEnable(2, true);
+        }
+    } else if (started) {
+        started = false;
+        AutotuneStop();
+    }
+
+    if (started && GetAutotuneState() != AUTOTUNE_RUNNING) {
+        started = false;
+        SchedulerTaskDisable(2);
+        if (GetAutotuneState() == AUTOTUNE_DONE) {
+            float gain;
+            uint32_t period;
+            GetAutotuneResult(&gain, &period);
+            UARTprintf("end [%d] period [%d] us\n", (int32_t) (gain * 1000),
+                    period);
+        } else {
+            UARTprintf("failed\n");
+        }
     }
 }
 
@@ -170,22 +180,22 @@ void Tuning() {
 void UpdateSerial() {
     int32_t data;
 
-    if (mode == MAIN_ROTOR) {
+    if (mode == AXIS_HEIGHT) {
         data = GetHeightPercentage();
-        if (data >= GetTargetHeight()) {
-            target_reached = true;
-        }
-    } else {
+    } else if (mode == AXIS_YAW) {
         data = GetYaw();
+    } else {
+        data = GetYawRate();
     }
 
-    int32_t time = SchedulerTickCountGet() * 1000 / PWM_FREQUENCY;
-    UARTprintf("%d, %d %d\n", data, GetPwmDutyCycle(MAIN_ROTOR), target_reached);
+    UARTprintf("%d, %d %d\n", data, GetPwmDutyCycle(MAIN_ROTOR),
+            GetPwmDutyCycle(TAIL_ROTOR));
 }
 
 int main(void) {
     Initialise();
     IntMasterEnable();
+    Start();
 
     while (1) {
         SchedulerRun();